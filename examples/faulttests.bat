@@ -0,0 +1,25 @@
+@echo off
+rem Inject increasing amounts of each kind of fault into a clean PE tape with csvtbin,
+rem decode each result with readtape, and collect the results in faults\faults.csv.
+rem (The file names can't have periods, so the fractional severities are written as 0.%%n)
+rem To graph them from Excel, open the CSV file, select a group of rows, then: insert chart 2D line
+if not exist 9trk_PE\faults mkdir 9trk_PE\faults
+cd 9trk_PE\faults
+if exist faults.csv del faults.csv
+set READ=readtape -m -ntrks=9 -pe -bpi=1600 -ips=50 -tap -sumr=faults.csv
+for %%n in (0 5 10 20 50 100) do (
+   csvtbin -tbinout=dropouts_%%n -dropouts=%%n -faulttrks=3 -descr="dropouts=%%n" ..\LJS009_part1_39blks
+   %READ% dropouts_%%n )
+for %%n in (2 4 6 8) do (
+   csvtbin -tbinout=sag_%%n -dropouts=50 -dropdepth=0.%%n -faulttrks=3 -descr="sag=0.%%n" ..\LJS009_part1_39blks
+   %READ% sag_%%n )
+for %%n in (02 05 10 20 30) do (
+   csvtbin -tbinout=noise_%%n -noise=0.%%n -descr="noise=0.%%n" ..\LJS009_part1_39blks
+   %READ% noise_%%n )
+for %%n in (1 2 3 5 7 9) do (
+   csvtbin -tbinout=jitter_%%n -jitter=0.%%n -descr="jitter=0.%%n" ..\LJS009_part1_39blks
+   %READ% jitter_%%n )
+for %%n in (1 2 3 4 5) do (
+   csvtbin -tbinout=skew_%%n -skew=%%n -faulttrks=0p -descr="skew=%%n" ..\LJS009_part1_39blks
+   %READ% skew_%%n )
+cd ..\..
@@ -75,6 +75,21 @@ V1.10        Add -stopaft, -starttime, -endtime options to truncate files.
 V1.11        Don't generated the trailing comma on the CSV header line for -read, 
              because it makes readtape think there is an extra track
 
+18 Oct 2026
+V1.12        Add -tbinout=<newbasefilename> to transform a .tbin file directly into
+             another .tbin file, without a round trip through a CSV file. These are
+             applied: -order, -invert, -skip, -subsample, -starttime, -endtime,
+             -stopaft, -scale, -maxvolts, and the documentation options.
+             Add -planar to write the samples in per-track groups, which is flagged
+             in the data header. All the ways of reading a .tbin file accept either.
+
+V1.13        Add fault injection options for -tbinout, to test how robust readtape is:
+             -dropouts, -droplen, -dropdepth, -faulttrks, -noise, -jitter, -skew, -seed.
+             Rename the log file variable, which conflicted with logf() in math.h.
+
+V1.14        Add -checksums to write a CRC-32 for each 1 MB chunk of the data, which is
+             flagged in the data header, and -verify to check them using all processors.
+
 --- FUTURE VERSION IDEAS ---
 
 - round up the auto-determined maxvolts even more, to reduce the number of
@@ -83,7 +98,7 @@ V1.11        Don't generated the trailing comma on the CSV header line for -read
   independent way to find out the size of the file and how far we're read.)
 
 ******************************************************************************/
-#define VERSION "1.11"
+#define VERSION "1.14"
 /******************************************************************************
 Copyright (C) 2018,2019,2022 Len Shustek
 
@@ -112,6 +127,16 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdbool.h>
 #include <time.h>
 #include <limits.h>
+#include <math.h>
+#if defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 typedef unsigned char byte;
 
 #include "csvtbin.h"
@@ -120,9 +145,13 @@ typedef unsigned char byte;
 #define MAXLINE 400
 #define MINTRKS 5
 #define PREREAD_COUNT 1000000
+#define FAULT_DELAY 64          // samples on either side of the fault delay line, for skew and jitter
+#define FAULT_JITTER_SAMPLES 10 // the approximate number of samples over which jitter changes
+#define VERIFY_MAXTHREADS 64    // the most threads we use for -verify
 
-FILE *inf, *outf, *graphf, *logf;
+FILE *inf, *outf, *graphf, *logfile;
 char *basefilename;
+char *tbinout_basefilename = NULL;
 char infilename[MAXPATH], outfilename[MAXPATH], graphfilename[MAXPATH], logfilename[MAXPATH];
 uint64_t num_samples = 0;
 uint64_t total_time = 0;
@@ -133,11 +162,31 @@ unsigned subsample = 1;
 unsigned ntrks = 9;
 unsigned int num_graph_vals = 0, graphbin = 0;
 float graphbin_max = 0, stagger = 0;
-bool do_read = false, display_header = false, redo = false, redid = false;
+bool do_read = false, display_header = false, redo = false, redid = false, do_transform = false;
+bool planar = false;          // -planar: write the samples in planar groups
+unsigned planar_in_groupsize = 0; // if the input .tbin file is planar, its group size
+int16_t *planar_raw = NULL;   // reading: a planar group as read from the file
+int16_t *planar_group = NULL; // reading: a planar group in interleaved order: all tracks of the first sample, etc.
+unsigned planar_count = 0;    // reading: the number of samples in planar_group
+unsigned planar_ndx = 0;      // reading: the next sample in planar_group to use
+unsigned planar_outcount = 0; // writing: the number of samples accumulated for the next group
+bool checksums = false;       // -checksums: write chunk checksums after the data
+bool do_verify = false;       // -verify: check the chunk checksums of a .tbin file
+unsigned verify_threads = 0;  // -threads=n: how many threads to use for -verify; 0 means one per processor
 bool little_endian;
 unsigned track_permutation[MAXTRKS] = { UINT_MAX };
 float scalefactor = 1.0f;
 float samples[MAXTRKS];
+// fault injection, for -tbinout
+bool do_faults = false;
+float fault_dropouts = 0;      // dropouts per second on each fault track
+float fault_droplen = 20;      // how long each dropout is, in usec
+float fault_dropdepth = 0;     // the fraction of the signal left during a dropout; 0.5 is a sag
+float fault_noise = 0;         // rms volts of noise added to all tracks
+float fault_jitter = 0;        // rms usec of timing jitter for all tracks
+float fault_skew = 0;          // usec of extra delay for the fault tracks
+const char *fault_trks = "0";  // which tracks get dropouts and skew
+unsigned fault_seed = 1;       // for the random number generator
 struct tbin_hdr_t hdr = { HDR_TAG };
 struct tbin_hdrext_trkorder_t hdrext_trkorder = { HDR_TRKORDER_TAG };
 struct tbin_dat_t dat = { DAT_TAG };
@@ -148,13 +197,13 @@ void logprintf(const char *msg, ...) {
    va_list args2;
    va_copy(args2, args);
    vfprintf(stdout, msg, args);  // to the console
-   if (logf) vfprintf(logf, msg, args2); // and maybe also the log file
+   if (logfile) vfprintf(logfile, msg, args2); // and maybe also the log file
    va_end(args2); }
 
 void vfatal(const char *msg, va_list args) {
    logprintf("\n***FATAL ERROR: ");
    vprintf(msg, args);
-   if (logf) vfprintf(logf, msg, args);
+   if (logfile) vfprintf(logfile, msg, args);
    logprintf("\n");
    exit(99); }
 
@@ -193,6 +242,20 @@ void SayUsage(void) {
       "  -read         read tbin and create csv; otherwise the opposite",
       "  -stagger=x    if -read, stagger each track by x volts for graphing",
       "  -showheader   just show the header info of a .tbin file, and check the data",
+      "  -tbinout=bbb  read a .tbin file and create a transformed bbb.tbin file",
+      "  -planar       write the .tbin samples in per-track groups instead of interleaved",
+      "  -checksums    write a checksum for each 1 MB chunk of the .tbin data",
+      "  -verify       check the checksums of a .tbin file, using all processors",
+      "  -threads=n    for -verify, use n threads instead of one per processor",
+      "fault injection for testing, only with -tbinout:",
+      "  -faulttrks=   the tracks for dropouts and skew, like 03p; the default is 0",
+      "  -dropouts=n   add an average of n dropouts per second on each of those tracks",
+      "  -droplen=x    make each dropout x usec long; the default is 20",
+      "  -dropdepth=x  leave x of the signal during dropouts; the default is 0, and 0.5 is a sag",
+      "  -noise=x      add random noise of x volts rms to all tracks",
+      "  -jitter=x     add random timing jitter of x usec rms to all tracks",
+      "  -skew=x       delay the fault tracks by x usec, which can be negative",
+      "  -seed=n       start the random number generator with n; the default is 1",
       "optional documentation that can be recorded in the TBIN file:",
       "  -descr=txt             a description of what is on the tape",
       "  -pe                    PE encoded",
@@ -306,6 +369,10 @@ bool parse_option(char *option) {
    const char *str;
    if (opt_key(arg, "READ")) do_read = true;
    else if (opt_key(arg, "SHOWHEADER"))  do_read = display_header = true;
+   else if (opt_str(arg, "TBINOUT=", &str)) {
+      assert(*str, "missing -tbinout= base filename");
+      tbinout_basefilename = (char *)str;
+      do_transform = true; }
    else if (opt_int(arg, "NTRKS=", &ntrks, MINTRKS, MAXTRKS))
       assert(track_permutation[0] == UINT_MAX, "can't give -ntrks after -order");
    else if (opt_str(arg, "ORDER=", &str)) {
@@ -341,6 +408,18 @@ bool parse_option(char *option) {
    else if (opt_int(arg, "GRAPH=", &graphbin, 1, INT_MAX)) {
       printf("will record the maximum excursion every %d samples\n", graphbin); }
    else if (opt_key(arg, "REDO")) redo = true;
+   else if (opt_key(arg, "PLANAR")) planar = true;
+   else if (opt_key(arg, "CHECKSUMS")) checksums = true;
+   else if (opt_key(arg, "VERIFY")) do_read = do_verify = true;
+   else if (opt_int(arg, "THREADS=", &verify_threads, 1, VERIFY_MAXTHREADS));
+   else if (opt_str(arg, "FAULTTRKS=", &fault_trks)) do_faults = true;
+   else if (opt_flt(arg, "DROPOUTS=", &fault_dropouts, 0, 1e5f)) do_faults = true;
+   else if (opt_flt(arg, "DROPLEN=", &fault_droplen, 0.01f, 1e5f)) do_faults = true;
+   else if (opt_flt(arg, "DROPDEPTH=", &fault_dropdepth, 0, 1)) do_faults = true;
+   else if (opt_flt(arg, "NOISE=", &fault_noise, 0, 15)) do_faults = true;
+   else if (opt_flt(arg, "JITTER=", &fault_jitter, 0, 100)) do_faults = true;
+   else if (opt_flt(arg, "SKEW=", &fault_skew, -100, 100)) do_faults = true;
+   else if (opt_int(arg, "SEED=", &fault_seed, 1, UINT_MAX)) do_faults = true;
    else if (option[2] == '\0') // single-character switches
       switch (toupper(option[1])) {
       case 'H':
@@ -485,7 +564,7 @@ void update_progress_count(void) {
       printf("%s", progress_buffer);
       progress_count = 0; } }
 
-void read_tbin(void) {
+void read_tbin_hdr(void) {
    assert(fread(&hdr, sizeof(hdr), 1, inf) == 1, "can't read hdr");
    assert(strcmp(hdr.tag, HDR_TAG) == 0, "bad hdr tag");
    if (!little_endian)  // convert all 4-byte integers in the header to big-endian
@@ -514,6 +593,58 @@ void read_tbin(void) {
    if (!little_endian) reverse8(&dat.tstart); // convert to big endian if necessary
    logprintf("%d bits/sample, data start time is %.6lf seconds\n", dat.sample_bits, (double)dat.tstart / 1e9);
    assert(dat.sample_bits == 16, "Sorry, we only support 16-bit voltage samples");
+   assert(!(dat.options & TDATOPT_deltas), "Sorry, we don't support delta-encoded samples");
+   if (dat.options & TDATOPT_planar) {
+      assert(dat.planar_log2 <= TBIN_PLANAR_MAXLOG2, "the planar group size of 2^%d samples is too big", dat.planar_log2);
+      logprintf("the samples are stored in planar groups of %d per track\n", 1 << dat.planar_log2);
+      planar_in_groupsize = 1 << dat.planar_log2; }
+   else planar_in_groupsize = 0;
+   if (dat.options & TDATOPT_checksums) {
+      assert(dat.checksum_log2 >= TBIN_CHECKSUM_MINLOG2 && dat.checksum_log2 <= TBIN_CHECKSUM_MAXLOG2,
+             "the checksum chunk size of 2^%d bytes is invalid", dat.checksum_log2);
+      logprintf("the data has a checksum for each chunk of %s bytes\n", intcommas(1 << dat.checksum_log2)); }
+   planar_count = planar_ndx = 0; }
+
+bool read_planar_group(void) { // read a planar group and transpose it; return false if it's empty
+   unsigned groupsize = planar_in_groupsize;
+   if (!planar_group) {
+      planar_raw = malloc(((size_t)1 << TBIN_PLANAR_MAXLOG2) * MAXTRKS * 2 + 2);
+      planar_group = malloc(((size_t)1 << TBIN_PLANAR_MAXLOG2) * MAXTRKS * 2);
+      assert(planar_raw && planar_group, "can't allocate planar group buffers"); }
+   size_t nread = fread(planar_raw, 2, groupsize * ntrks, inf);
+   if (!little_endian)
+      for (size_t i = 0; i < nread; ++i) reverse2((uint16_t *)&planar_raw[i]);
+   unsigned count = 0; // find how many samples are in this group, which might be the last one
+   while (count < groupsize && count < nread && planar_raw[count] != -32768 /*0x8000*/) ++count;
+   bool last = count < groupsize;
+   assert(count < nread || (!last && nread > 0), "the .tbin file ended without an end marker");
+   assert(nread >= (size_t)count * ntrks + last, "the .tbin file ended in the middle of a planar group");
+   for (unsigned trk = 0; trk < ntrks; ++trk) { // transpose to interleaved order
+      int16_t *plane = planar_raw + (trk == 0 ? 0 : trk * count + last); // (the end marker follows track 0)
+      for (unsigned i = 0; i < count; ++i) planar_group[i * ntrks + trk] = plane[i]; }
+   planar_count = count;
+   planar_ndx = 0;
+   return count > 0; }
+
+bool read_tbin_sample(int16_t *data) { // read the data for all tracks of the next sample; return false at the end marker
+   if (planar_in_groupsize) {
+      if (planar_ndx >= planar_count) {
+         if (planar_count > 0 && planar_count < planar_in_groupsize) return false; // that was the last group
+         if (!read_planar_group()) return false; }
+      memcpy(data, &planar_group[planar_ndx++ * ntrks], ntrks * 2);
+      return true; }
+   assert(fread(&data[0], 2, 1, inf) == 1, "the .tbin file ended without an end marker");
+   if (!little_endian) reverse2((uint16_t *)&data[0]);
+   if (data[0] == -32768 /*0x8000*/) return false; // endfile
+   assert(fread(&data[1], 2, ntrks - 1, inf) == ntrks - 1, "can't read data for tracks 1.. at sample %s, data[0]=%08X",
+          longlongcommas(num_samples), data[0]);
+   if (!little_endian)
+      for (unsigned trk = 1; trk < ntrks; ++trk)
+         reverse2((uint16_t *)&data[trk]);
+   return true; }
+
+void read_tbin(void) {
+   read_tbin_hdr();
    if (!display_header) {
       fprintf(outf, "'%s\nTime, ", hdr.descr); // first line is description, second is column headings
       for (unsigned i = 0; i < ntrks; ++i) fprintf(outf, "Track %d%s", i, i == ntrks-1 ? "" : ", ");
@@ -525,7 +656,7 @@ void read_tbin(void) {
       logprintf("skipping %d-track samples\n", ntrks);
       uint64_t skipped = 0;
       do {
-         assert(fread(data, 2, ntrks, inf) == ntrks, "endfile with samples left to skip");
+         assert(read_tbin_sample(data), "endfile with samples left to skip");
          timenow += hdr.u.s.tdelta;
          ++skipped;
          if (skip_samples > 0) --skip_samples; }
@@ -533,14 +664,7 @@ void read_tbin(void) {
       logprintf("skipped %s samples\n", longlongcommas(skipped)); }
 
    while (1) {  // write one .CSV file line for each sample we read
-      assert(fread(&data[0], 2, 1, inf) == 1, "can't read data for track 0 at time %.8lf", (double)timenow / 1e9);
-      if (!little_endian) reverse2((uint16_t *)&data[0]);
-      if (data[0] == -32768 /*0x8000*/) break; // endfile
-      assert(fread(&data[1], 2, ntrks - 1, inf) == ntrks - 1, "can't read data for tracks 1.. at time %.8lf, data[0]=%08X",
-             (double)timenow / 1e9, data[0]);
-      if (!little_endian)
-         for (unsigned trk = 1; trk < ntrks; ++trk)
-            reverse2((uint16_t *)&data[trk]);
+      if (!read_tbin_sample(data)) break; // endfile
       // The %f floating-point display formatting is quite slow. If the -read option is ever used for production, we
       // should write fast special-purpose routines, as we did for parsing floating-point input. Could be 10x faster!
       if (!display_header) fprintf(outf, "%12.8lf, ", (double)timenow / 1e9);
@@ -560,6 +684,53 @@ void read_tbin(void) {
       update_progress_count(); }
    logprintf("\n"); };
 
+/********************************************************************
+   Chunk checksums, for -checksums and -verify
+
+   The data bytes are checksummed as they are written, in chunks of
+   2^TBIN_CHECKSUM_LOG2 bytes, and the table of checksums and the
+   trailer that locates it are added after the end marker.
+*********************************************************************/
+uint32_t *chk_table = NULL;   // writing: the checksums of the chunks finished so far
+uint32_t chk_count = 0, chk_allocated = 0;
+uint32_t chk_crc;             // writing: the checksum of the current chunk so far
+uint32_t chk_chunkbytes;      // writing: how many bytes are in the current chunk so far
+uint64_t chk_datasize;        // writing: how many data bytes have been written
+
+void chk_start(void) { // start checksumming the data, which might be the second time for -redo
+   chk_count = chk_chunkbytes = 0;
+   chk_crc = 0;
+   chk_datasize = 0; }
+
+void chk_chunk_done(void) {
+   if (chk_count >= chk_allocated) {
+      chk_allocated = chk_allocated ? 2 * chk_allocated : 1024;
+      chk_table = realloc(chk_table, chk_allocated * sizeof(uint32_t));
+      assert(chk_table, "can't allocate the checksum table"); }
+   chk_table[chk_count++] = chk_crc;
+   chk_crc = chk_chunkbytes = 0; }
+
+void write_data(const byte *buf, size_t len) { // write data bytes, and checksum them if we're doing that
+   assert(fwrite(buf, 1, len, outf) == len, "can't write the .tbin data after sample %s", longlongcommas(num_samples));
+   if (!checksums) return;
+   chk_datasize += len;
+   while (len > 0) { // the buffer might cross into the next chunk
+      size_t n = ((size_t)1 << TBIN_CHECKSUM_LOG2) - chk_chunkbytes;
+      if (n > len) n = len;
+      chk_crc = crc_update(chk_crc, buf, n);
+      chk_chunkbytes += (uint32_t)n;
+      buf += n;
+      len -= n;
+      if (chk_chunkbytes == 1 << TBIN_CHECKSUM_LOG2) chk_chunk_done(); } }
+
+void write_checksums(void) { // write the checksum table and the trailer after the end marker
+   if (chk_chunkbytes > 0) chk_chunk_done(); // the last chunk is short
+   for (uint32_t i = 0; i < chk_count; ++i) output4(chk_table[i]);
+   output8(chk_datasize);
+   output4(chk_count);
+   assert(fwrite(CHK_TAG, 4, 1, outf) == 1, "can't write the checksum trailer");
+   logprintf("\nwrote %s checksums for %s data bytes\n", intcommas(chk_count), longlongcommas(chk_datasize)); }
+
 void write_tbin_hdr(void) {
    // create and write the ID block
    hdr.u.s.tbinhdrsize = sizeof(hdr);
@@ -576,10 +747,352 @@ void write_tbin_hdr(void) {
       assert(fwrite(&hdrext_trkorder, sizeof(hdrext_trkorder), 1, outf) == 1, "can't write hdr trkorder extension");
    // complete and write the data header, of which there could eventually be more than one.
    dat.sample_bits = 16;  // the only thing we support right now
+   dat.options = planar ? TDATOPT_planar : 0;
+   dat.planar_log2 = planar ? TBIN_PLANAR_LOG2 : 0;
+   if (checksums) dat.options |= TDATOPT_checksums;
+   dat.checksum_log2 = checksums ? TBIN_CHECKSUM_LOG2 : 0;
+   planar_outcount = 0;
+   if (checksums) chk_start();
    assert(fwrite(dat.tag, sizeof(dat)-sizeof(dat.tstart), 1, outf) == 1, "can't write dat tag");
    output8(dat.tstart); // write separately because of possible endian reversal
 }
 
+int16_t planar_out[(1 << TBIN_PLANAR_LOG2) * MAXTRKS]; // writing: the group being accumulated, in interleaved order
+
+void write_planar_group(bool last) { // write the accumulated samples one track at a time
+   static byte outbuf[(1 << TBIN_PLANAR_LOG2) * MAXTRKS * 2 + 2];
+   int outndx = 0;
+   for (unsigned trk = 0; trk < ntrks; ++trk) {
+      for (unsigned i = 0; i < planar_outcount; ++i) { // generate the little-endian output
+         int16_t sample = planar_out[i * ntrks + trk];
+         outbuf[outndx++] = sample & 0xff;
+         outbuf[outndx++] = (sample >> 8) & 0xff; }
+      if (last && trk == 0) { // the end marker goes after the last group's track 0
+         outbuf[outndx++] = 0x00;
+         outbuf[outndx++] = 0x80; } }
+   write_data(outbuf, outndx);
+   planar_outcount = 0; }
+
+void write_tbin_sample(int16_t *data) { // write the data for all tracks of the next sample
+   if (planar) {
+      memcpy(&planar_out[planar_outcount * ntrks], data, ntrks * 2);
+      if (++planar_outcount == 1 << TBIN_PLANAR_LOG2) write_planar_group(false); }
+   else {
+      byte outbuf[MAXTRKS * 2]; // accumulate data for all tracks, for faster writing
+      for (unsigned trk = 0; trk < ntrks; ++trk) { // generate the little-endian output
+         outbuf[2 * trk] = data[trk] & 0xff;
+         outbuf[2 * trk + 1] = (data[trk] >> 8) & 0xff; }
+      write_data(outbuf, 2 * ntrks); } }
+
+void write_tbin_end(void) { // finish the data
+   static const byte endmarker[2] = { 0x00, 0x80 };
+   if (planar) write_planar_group(true);
+   else write_data(endmarker, 2);
+   if (checksums) write_checksums(); }
+
+struct verify_job_t {   // what one -verify thread does
+   int64_t datapos;        // the file position of the first data byte
+   uint64_t datasize;      // the number of data bytes
+   uint32_t first, last;   // the range of chunks to check, not including "last"
+   byte *bad;              // where to record which chunks are bad
+   uint32_t nbad; };       // how many bad chunks this thread found
+
+#if defined(_WIN32)
+unsigned __stdcall verify_thread(void *arg) {
+#else
+void *verify_thread(void *arg) {
+#endif
+   struct verify_job_t *job = arg;
+   size_t chunksize = (size_t)1 << dat.checksum_log2;
+   byte *buf = malloc(chunksize);
+   FILE *f = fopen(infilename, "rb"); // each thread has its own file position
+   assert(buf && f, "can't start a -verify thread");
+   assert(fseeko(f, job->datapos + (int64_t)job->first * chunksize, SEEK_SET) == 0, "fseek failed");
+   for (uint32_t chunk = job->first; chunk < job->last; ++chunk) { // (the chunks are contiguous)
+      size_t len = chunksize;
+      if ((uint64_t)chunk * chunksize + len > job->datasize) len = (size_t)(job->datasize - (uint64_t)chunk * chunksize);
+      if (fread(buf, 1, len, f) != len || crc_update(0, buf, len) != chk_table[chunk]) {
+         job->bad[chunk] = 1;
+         ++job->nbad; } }
+   fclose(f);
+   free(buf);
+   return 0; }
+
+unsigned num_processors(void) {
+#if defined(_WIN32)
+   SYSTEM_INFO info;
+   GetSystemInfo(&info);
+   return info.dwNumberOfProcessors;
+#else
+   long n = sysconf(_SC_NPROCESSORS_ONLN);
+   return n > 0 ? (unsigned)n : 1;
+#endif
+}
+
+uint32_t verify_tbin(void) { // check the chunk checksums of a .tbin file, and return how many are bad
+   read_tbin_hdr();
+   assert(dat.options & TDATOPT_checksums, "the .tbin file doesn't have checksums; use csvtbin -tbinout -checksums to add them");
+   int64_t datapos = ftello(inf);
+   byte trailer[sizeof(struct tbin_chk_t)]; // read it byte by byte, because it's little-endian
+   assert(datapos >= 0 && fseeko(inf, -(int64_t)sizeof(trailer), SEEK_END) == 0, "fseek failed");
+   int64_t trailerpos = ftello(inf);
+   assert(fread(trailer, sizeof(trailer), 1, inf) == 1, "can't read the checksum trailer");
+   assert(strcmp((char *)trailer + 12, CHK_TAG) == 0, "the .tbin file doesn't end with the checksum trailer; it might be truncated");
+   uint64_t datasize = 0;
+   uint32_t nchunks = 0;
+   for (int i = 7; i >= 0; --i) datasize = (datasize << 8) | trailer[i];
+   for (int i = 11; i >= 8; --i) nchunks = (nchunks << 8) | trailer[i];
+   size_t chunksize = (size_t)1 << dat.checksum_log2;
+   assert(nchunks == (datasize + chunksize - 1) / chunksize
+          && datapos + (int64_t)datasize + 4 * (int64_t)nchunks == trailerpos,
+          "the checksum trailer doesn't agree with the size of the file");
+   chk_table = malloc(nchunks * sizeof(uint32_t) + 1);
+   byte *bad = calloc(nchunks + 1, 1);
+   assert(chk_table && bad, "can't allocate the checksum table");
+   assert(fseeko(inf, datapos + (int64_t)datasize, SEEK_SET) == 0, "fseek failed");
+   for (uint32_t i = 0; i < nchunks; ++i) {
+      byte b[4];
+      assert(fread(b, 4, 1, inf) == 1, "can't read the checksum table");
+      chk_table[i] = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24; }
+   crc_update(0, NULL, 0); // (make its table now, before the threads share it)
+
+   unsigned nthreads = verify_threads ? verify_threads : num_processors();
+   if (nthreads > VERIFY_MAXTHREADS) nthreads = VERIFY_MAXTHREADS;
+   if (nthreads > nchunks) nthreads = nchunks > 0 ? nchunks : 1;
+   logprintf("checking %s chunks of %s data bytes with %d thread%s\n",
+             intcommas(nchunks), longlongcommas(datasize), nthreads, nthreads > 1 ? "s" : "");
+   struct verify_job_t jobs[VERIFY_MAXTHREADS];
+#if defined(_WIN32)
+   HANDLE threads[VERIFY_MAXTHREADS];
+#else
+   pthread_t threads[VERIFY_MAXTHREADS];
+#endif
+   for (unsigned i = 0; i < nthreads; ++i) { // give each thread a contiguous range of chunks
+      jobs[i].datapos = datapos;
+      jobs[i].datasize = datasize;
+      jobs[i].first = (uint32_t)((uint64_t)nchunks * i / nthreads);
+      jobs[i].last = (uint32_t)((uint64_t)nchunks * (i + 1) / nthreads);
+      jobs[i].bad = bad;
+      jobs[i].nbad = 0;
+#if defined(_WIN32)
+      threads[i] = (HANDLE)_beginthreadex(NULL, 0, verify_thread, &jobs[i], 0, NULL);
+      assert(threads[i] != 0, "can't create thread %d", i);
+#else
+      assert(pthread_create(&threads[i], NULL, verify_thread, &jobs[i]) == 0, "can't create thread %d", i);
+#endif
+   }
+   uint32_t nbad = 0;
+   for (unsigned i = 0; i < nthreads; ++i) {
+#if defined(_WIN32)
+      WaitForSingleObject(threads[i], INFINITE);
+      CloseHandle(threads[i]);
+#else
+      pthread_join(threads[i], NULL);
+#endif
+      nbad += jobs[i].nbad; }
+
+   uint64_t samplebytes = 2 * ntrks; // (for planar files the times are for the group that includes the chunk)
+   for (uint32_t chunk = 0; chunk < nchunks; ++chunk)
+      if (bad[chunk]) {
+         uint64_t from = (uint64_t)chunk * chunksize, to = from + chunksize;
+         if (to > datasize) to = datasize;
+         if (planar_in_groupsize) {
+            from = from / (samplebytes * planar_in_groupsize) * samplebytes * planar_in_groupsize;
+            to = (to + samplebytes * planar_in_groupsize - 1) / (samplebytes * planar_in_groupsize) * samplebytes * planar_in_groupsize; }
+         logprintf("*** WARNING *** chunk %s is bad: data bytes %s", intcommas(chunk), longlongcommas(from));
+         logprintf(" to %s, times %.6lf to %.6lf seconds\n", longlongcommas(to),
+                   (double)(dat.tstart + from / samplebytes * hdr.u.s.tdelta) / 1e9,
+                   (double)(dat.tstart + to / samplebytes * hdr.u.s.tdelta) / 1e9); }
+   if (nbad) logprintf("%u of the %s chunks are bad\n", nbad, intcommas(nchunks));
+   else logprintf("all %s chunks are good\n", intcommas(nchunks));
+   num_samples = (datasize - 2) / samplebytes;
+   total_time = num_samples * hdr.u.s.tdelta;
+   free(bad);
+   return nbad; }
+
+/********************************************************************
+   Fault injection for -tbinout, to test how well readtape copes.
+
+   Samples go through a delay line so that tracks can be skewed and
+   jittered by fractions of a sample using linear interpolation. Then
+   dropouts and noise are added. Everything random comes from our own
+   generator, so a given -seed creates the same faults everywhere.
+*********************************************************************/
+static uint64_t fault_rng_state;
+static unsigned fault_trkmask;
+#define FAULT_LINE_SIZE (2 * FAULT_DELAY + 1)
+static float fault_line[FAULT_LINE_SIZE][MAXTRKS];
+static uint64_t fault_count = 0;
+static float fault_skew_samples, fault_jitter_samples, fault_noise_units, fault_drop_prob;
+static int fault_drop_samples, fault_drop_left[MAXTRKS];
+static float fault_jitter_now = 0;
+static long long fault_num_dropouts = 0, fault_num_clipped = 0;
+
+static double fault_random(void) { // xorshift64*: uniform in [0,1)
+   fault_rng_state ^= fault_rng_state >> 12;
+   fault_rng_state ^= fault_rng_state << 25;
+   fault_rng_state ^= fault_rng_state >> 27;
+   return (double)((fault_rng_state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0; }
+
+static double fault_gaussian(void) { // Box-Muller: mean 0, standard deviation 1
+   double u = fault_random();
+   if (u < 1e-300) u = 1e-300;
+   return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * fault_random()); }
+
+void fault_init(void) { // call after the output header is complete
+   fault_rng_state = 0x9E3779B97F4A7C15ULL * fault_seed;
+   fault_trkmask = 0;
+   for (const char *p = fault_trks; *p; ++p) {
+      unsigned trk = toupper(*p) == 'P' ? ntrks - 1 : (unsigned)(*p - '0');
+      assert(trk < ntrks, "bad -faulttrks track: %c", *p);
+      fault_trkmask |= 1 << trk; }
+   double usec_per_sample = hdr.u.s.tdelta / 1e3;
+   fault_skew_samples = (float)(fault_skew / usec_per_sample);
+   fault_jitter_samples = (float)(fault_jitter / usec_per_sample);
+   assert(fabsf(fault_skew_samples) + 4 * fault_jitter_samples < FAULT_DELAY - 1,
+          "-skew and -jitter are too big; they must be less than %d samples together", FAULT_DELAY);
+   fault_noise_units = fault_noise / hdr.u.s.maxvolts * 32767;
+   fault_drop_samples = (int)(fault_droplen / usec_per_sample + 0.5);
+   fault_drop_prob = (float)(fault_dropouts * hdr.u.s.tdelta / 1e9);
+   logprintf("injecting faults with seed %u: ", fault_seed);
+   if (fault_dropouts > 0) logprintf("%.1f dropouts/sec of %.1f usec leaving %.2f of the signal on tracks %s, ",
+                                        fault_dropouts, fault_droplen, fault_dropdepth, fault_trks);
+   if (fault_skew != 0) logprintf("skew of %.2f usec on tracks %s, ", fault_skew, fault_trks);
+   logprintf("noise %.3fV, jitter %.3f usec\n", fault_noise, fault_jitter); }
+
+static void fault_emit(void) { // write the sample in the middle of the delay line, with faults added
+   int64_t center = (int64_t)fault_count - 1 - FAULT_DELAY;
+   int16_t out[MAXTRKS];
+   if (fault_jitter_samples > 0) { // jitter is a random process that changes slowly from sample to sample
+      const float a = 1.0f - 1.0f / FAULT_JITTER_SAMPLES;
+      fault_jitter_now = a * fault_jitter_now + sqrtf(1 - a * a) * fault_jitter_samples * (float)fault_gaussian(); }
+   for (unsigned trk = 0; trk < ntrks; ++trk) {
+      double pos = center + fault_jitter_now;
+      if (fault_trkmask & (1 << trk)) pos -= fault_skew_samples;
+      int64_t ndx = (int64_t)floor(pos);
+      float frac = (float)(pos - ndx);
+      ndx += FAULT_LINE_SIZE; // the first samples can look before the start, where the line is prefilled
+      float v0 = fault_line[ndx % FAULT_LINE_SIZE][trk];
+      float v1 = fault_line[(ndx + 1) % FAULT_LINE_SIZE][trk];
+      float v = v0 + (v1 - v0) * frac;
+      if (fault_trkmask & (1 << trk)) {
+         if (fault_drop_left[trk] == 0 && fault_drop_prob > 0 && fault_random() < fault_drop_prob) {
+            fault_drop_left[trk] = fault_drop_samples;
+            ++fault_num_dropouts; }
+         if (fault_drop_left[trk] > 0) {
+            v *= fault_dropdepth;
+            --fault_drop_left[trk]; } }
+      if (fault_noise_units > 0) v += fault_noise_units * (float)fault_gaussian();
+      int32_t sample = (int32_t)(v + (v < 0 ? -0.5f : 0.5f));
+      if (sample < -32767 || sample > 32767) {
+         sample = sample < 0 ? -32767 : 32767;
+         ++fault_num_clipped; }
+      out[trk] = (int16_t)sample; }
+   write_tbin_sample(out); }
+
+void fault_sample(int16_t *in) { // put the next sample into the delay line, and write one if it's full enough
+   if (fault_count == 0) // start with the line full of the first sample
+      for (int i = 0; i < FAULT_LINE_SIZE; ++i)
+         for (unsigned trk = 0; trk < ntrks; ++trk) fault_line[i][trk] = in[trk];
+   for (unsigned trk = 0; trk < ntrks; ++trk) fault_line[fault_count % FAULT_LINE_SIZE][trk] = in[trk];
+   if (++fault_count > FAULT_DELAY) fault_emit(); }
+
+void fault_flush(void) { // write the last samples still in the delay line
+   if (fault_count == 0) return;
+   int16_t last[MAXTRKS];
+   for (unsigned trk = 0; trk < ntrks; ++trk) last[trk] = (int16_t)fault_line[(fault_count - 1) % FAULT_LINE_SIZE][trk];
+   uint64_t num = fault_count < FAULT_DELAY ? fault_count : FAULT_DELAY;
+   for (uint64_t i = 0; i < num; ++i) { // pad with copies of the last sample
+      for (unsigned trk = 0; trk < ntrks; ++trk) fault_line[fault_count % FAULT_LINE_SIZE][trk] = last[trk];
+      ++fault_count;
+      fault_emit(); }
+   logprintf("\n%s dropouts were injected", longlongcommas(fault_num_dropouts));
+   if (fault_num_clipped) logprintf(", and %s faulty samples had to be clipped", longlongcommas(fault_num_clipped));
+   logprintf("\n"); }
+
+void transform_tbin(void) { // read a .tbin file and write a transformed .tbin file
+   struct tbin_hdr_t opthdr = hdr;  // what the options said
+   struct tbin_hdrext_trkorder_t opttrkorder = hdrext_trkorder;
+   unsigned optntrks = ntrks;
+   bool order_given = track_permutation[0] != UINT_MAX;
+   read_tbin_hdr();
+   struct tbin_hdr_t inhdr = hdr;
+   uint64_t in_tstart = dat.tstart;
+
+   // the options override what was in the input file
+   if (opthdr.descr[0]) strcpy(hdr.descr, opthdr.descr);
+   if (opthdr.u.s.mode != UNKNOWN) hdr.u.s.mode = opthdr.u.s.mode;
+   if (opthdr.u.s.bpi != 0) hdr.u.s.bpi = opthdr.u.s.bpi;
+   if (opthdr.u.s.ips != 0) hdr.u.s.ips = opthdr.u.s.ips;
+   if (opthdr.u.s.time_written.tm_year > 0) hdr.u.s.time_written = opthdr.u.s.time_written;
+   if (opthdr.u.s.time_read.tm_year > 0) hdr.u.s.time_read = opthdr.u.s.time_read;
+   if (opthdr.u.s.maxvolts != 0) hdr.u.s.maxvolts = opthdr.u.s.maxvolts;
+   hdr.u.s.flags |= opthdr.u.s.flags & TBIN_REVERSED;
+   bool invert = (opthdr.u.s.flags & TBIN_INVERTED) != 0;
+   if (invert) hdr.u.s.flags ^= TBIN_INVERTED;  // inverting twice undoes it
+   if (opthdr.u.s.flags & TBIN_TRKORDER_INCLUDED) { // a new Whirlwind -order string replaces the old one
+      hdrext_trkorder = opttrkorder;
+      assert(strlen(hdrext_trkorder.trkorder) == inhdr.u.s.ntrks, "-order=%s doesn't match the %d tracks in the file",
+             hdrext_trkorder.trkorder, inhdr.u.s.ntrks);
+      hdr.u.s.flags |= TBIN_TRKORDER_INCLUDED + TBIN_NO_REORDER;
+      order_given = false; }
+   if (order_given) {
+      assert(optntrks == ntrks, "-order was for %d tracks, but the file has %d", optntrks, ntrks);
+      hdr.u.s.flags &= ~TBIN_NO_REORDER;  // the tracks are now in canonical order
+      logprintf("the tracks will be reordered\n"); }
+   else for (unsigned i = 0; i < ntrks; ++i) track_permutation[i] = i;
+   bool rescale = hdr.u.s.maxvolts != inhdr.u.s.maxvolts || scalefactor != 1.0f;
+   float sample_scale = inhdr.u.s.maxvolts / hdr.u.s.maxvolts * scalefactor; // converts input to output sample units
+   if (rescale) logprintf("samples will be rescaled for a maximum of %.2fV\n", hdr.u.s.maxvolts);
+
+   // figure out which input sample will be the first output sample
+   uint64_t first_sample = skip_samples;
+   if (starttime > in_tstart) {
+      uint64_t first_by_time = (starttime - in_tstart + inhdr.u.s.tdelta - 1) / inhdr.u.s.tdelta;
+      if (first_by_time > first_sample) first_sample = first_by_time; }
+   first_sample += subsample - 1;  // we use the nth sample of each group of n, as for CSV files
+   dat.tstart = in_tstart + first_sample * inhdr.u.s.tdelta;
+   hdr.u.s.tdelta = inhdr.u.s.tdelta * subsample;
+   if (first_sample > 0 || subsample > 1)
+      logprintf("the output data starts at %.6lf seconds, with samples every %.2lf usec\n",
+                (double)dat.tstart / 1e9, (double)hdr.u.s.tdelta / 1e3);
+   write_tbin_hdr();
+   if (do_faults) fault_init();
+
+   uint64_t sample_ndx = 0;  // input sample number
+   uint64_t sample_time = in_tstart;  // and its time
+   long long count_toosmall = 0, count_toobig = 0;
+   int16_t in[MAXTRKS], out[MAXTRKS];
+   while (read_tbin_sample(in)) {  // process one sample
+      if (sample_ndx >= first_sample && (sample_ndx - first_sample) % subsample == 0) {
+         for (unsigned trk = 0; trk < ntrks; ++trk) {  // permute, and maybe rescale and invert
+            int32_t sample = in[trk];
+            if (rescale) {
+               float fsample = sample * sample_scale;
+               sample = (int32_t)(fsample + (fsample < 0 ? -0.5f : 0.5f)); // (int) truncates towards zero
+               if (sample <= -32767) {
+                  sample = -32767; ++count_toosmall; }
+               if (sample >= 32767) {
+                  sample = 32767; ++count_toobig; } }
+            if (invert) sample = -sample;
+            out[track_permutation[trk]] = (int16_t)sample; }
+         if (do_faults) fault_sample(out);
+         else write_tbin_sample(out);
+         total_time += hdr.u.s.tdelta;
+         update_progress_count();
+         if (++num_samples >= stopaft || sample_time > endtime) break; }
+      ++sample_ndx;
+      sample_time += inhdr.u.s.tdelta; }
+   if (do_faults) fault_flush();
+   write_tbin_end();
+   logprintf("\n");
+   if (count_toobig)
+      logprintf("*** WARNING ***  %s samples were too big\n", longlongcommas(count_toobig));
+   if (count_toosmall)
+      logprintf("*** WARNING ***  %s samples were too small\n", longlongcommas(count_toosmall));
+   if (count_toobig || count_toosmall)
+      logprintf("you should specify a bigger -maxvolts than %.1f\n", hdr.u.s.maxvolts); }
+
 void csv_preread(void) {
    // preread the beginning of the CSV file for two reasons:
    // 1. to compute the sample delta accurately
@@ -656,8 +1169,7 @@ void write_tbin(void) {
          scanfast_double(&linep); // scan and discard the timestamp
          for (unsigned trk = 0; trk < ntrks; ++trk)  // read and permute the samples
             samples[track_permutation[trk]] = scanfast_float(&linep) * scalefactor;
-         byte outbuf[MAXTRKS * 2]; // accumulate data for all tracks, for faster writing
-         int bufndx = 0;
+         int16_t outsamples[MAXTRKS];
          for (unsigned trk = 0; trk < ntrks; ++trk) { // generate the little-endian integer samples
             fsample = samples[trk];
             if (hdr.u.s.flags & TBIN_INVERTED) fsample = -fsample;  // invert, if told to
@@ -673,10 +1185,9 @@ void write_tbin(void) {
                sample = -32767; ++count_toosmall; }
             if (sample >= 32767) {
                sample = 32767;  ++count_toobig; }
-            outbuf[bufndx++] = ((int16_t)sample) & 0xff;
-            outbuf[bufndx++] = ((int16_t)sample) >> 8; }
+            outsamples[trk] = (int16_t)sample; }
          //printf("\n");
-         assert(fwrite(outbuf, 2, ntrks, outf) == ntrks, "can't write data sample %lld", num_samples);
+         write_tbin_sample(outsamples);
          sample_time += hdr.u.s.tdelta;
          total_time += hdr.u.s.tdelta;
          if (++num_samples >= stopaft) break;
@@ -687,7 +1198,7 @@ void write_tbin(void) {
             num_graph_vals = 0; }
          update_progress_count(); }
 done:
-      output2(0x8000); // end marker
+      write_tbin_end();
       logprintf("\ndone; minimum voltage was %.1fV, maximum voltage was %.1fV\n", minvolts, maxvolts);
       if (count_toobig)
          logprintf("*** WARNING ***  %s samples were too big\n", longlongcommas(count_toobig));
@@ -739,25 +1250,32 @@ int main(int argc, char *argv[]) {
 
    strncpy(logfilename, basefilename, MAXPATH - 15); logfilename[MAXPATH - 15] = 0;
    strcat(logfilename, ".csvtbin.log");
-   logf = fopen(logfilename, "w");
-   assert(logf, "file create failed for %s", logfilename);
-   fprintf(logf, "CSVTBIN version %s compiled on %s at %s\n", VERSION, __DATE__, __TIME__);
+   logfile = fopen(logfilename, "w");
+   assert(logfile, "file create failed for %s", logfilename);
+   fprintf(logfile, "CSVTBIN version %s compiled on %s at %s\n", VERSION, __DATE__, __TIME__);
    logprintf("command line: ");
    for (int i = 0; i < argc; ++i)  // for documentation, show invocation options
       logprintf("%s ", argv[i]);
    logprintf("\n");
 
    strncpy(infilename, basefilename, MAXPATH - 10); infilename[MAXPATH - 10] = 0;
-   strcat(infilename, do_read ? ".tbin": ".csv");
+   strcat(infilename, do_read || do_transform ? ".tbin": ".csv");
    logprintf("opening  %s\n", infilename);
-   inf = fopen(infilename, do_read ? "rb" : "r");
+   inf = fopen(infilename, do_read || do_transform ? "rb" : "r");
    assert(inf, "unable to open input file %s", infilename);
 
-   strncpy(outfilename, basefilename, MAXPATH - 10); outfilename[MAXPATH - 10] = 0;
+   assert(!do_faults || do_transform, "fault injection is only done with -tbinout");
+   if (do_transform) {
+      assert(!do_read, "can't do both -read and -tbinout");
+      assert(strcmp(tbinout_basefilename, basefilename) != 0, "-tbinout can't be the same as the input file");
+      strncpy(outfilename, tbinout_basefilename, MAXPATH - 10); }
+   else strncpy(outfilename, basefilename, MAXPATH - 10);
+   outfilename[MAXPATH - 10] = 0;
    strcat(outfilename, do_read ? ".csv" : ".tbin");
-   logprintf("creating %s\n", outfilename);
-   outf = fopen(outfilename, do_read ? "w" : "wb");
-   assert(outf, "file create failed for %s", outfilename);
+   if (!do_verify) logprintf("creating %s\n", outfilename);
+   if (!do_verify) {
+      outf = fopen(outfilename, do_read ? "w" : "wb");
+      assert(outf, "file create failed for %s", outfilename); }
 
    if (graphbin) {
       strncpy(graphfilename, basefilename, MAXPATH - 12); graphfilename[MAXPATH - 12] = 0;
@@ -766,13 +1284,14 @@ int main(int argc, char *argv[]) {
       graphf = fopen(graphfilename, "w");
       assert(graphf, "file create failed for %s", graphfilename); }
 
-   if (track_permutation[0] == UINT_MAX) { // no input value permutation was given
+   if (do_transform) ; // the track order is resolved after reading the input header
+   else if (track_permutation[0] == UINT_MAX) { // no input value permutation was given
       if (!do_read && !(hdr.u.s.flags & TBIN_TRKORDER_INCLUDED)) {
          logprintf("WARNING: using the default track ordering, and marking the .tbin file to show it wasn't given\n");
          hdr.u.s.flags |= TBIN_NO_REORDER; }
       for (unsigned i = 0; i < ntrks; ++i) track_permutation[i] = i; // create default
    }
-   if (!display_header) {
+   if (!display_header && !do_transform) {
       logprintf("%s track order: ", do_read ? "output" : "input");
       if (hdr.u.s.flags & TBIN_TRKORDER_INCLUDED)
          logprintf(hdrext_trkorder.trkorder);
@@ -788,7 +1307,10 @@ int main(int argc, char *argv[]) {
       logprintf("input voltages will be scaled by %f\n", scalefactor);
 
    time_t start_time = time(NULL);
-   if (do_read) read_tbin();
+   uint32_t num_bad_chunks = 0;
+   if (do_verify) num_bad_chunks = verify_tbin();
+   else if (do_read) read_tbin();
+   else if (do_transform) transform_tbin();
    else write_tbin();
 
    logprintf("%s samples representing %.3lf tape seconds were processed in %.1f seconds\n",
@@ -796,6 +1318,6 @@ int main(int argc, char *argv[]) {
    fclose(inf);
    if (outf) fclose(outf);
    if (graphf) fclose(graphf);
-   return 0; };
+   return num_bad_chunks ? 3 : 0; };
 
 //*
\ No newline at end of file
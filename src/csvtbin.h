@@ -78,10 +78,18 @@ struct tbin_dat_t {     // the data header that starts each block of data
 #define DAT_TAG "DAT"
    byte options;                    // data format options, TDATOPT_xxx
 #define TDATOPT_deltas 0x01         // is each sample a delta from the previous sample?
+#define TDATOPT_planar 0x02         // are the samples stored in groups, one track after another?
+#define TDATOPT_checksums 0x04      // is the data followed by a table of chunk checksums?
    byte sample_bits;                // number of bits for each voltage sample
-   byte rsvd1, rsvd2;               // reserved fields so that the next field is on an 8-byte boundary
+   byte planar_log2;                // for TDATOPT_planar: log2 of the number of samples per track in each group
+   byte checksum_log2;              // for TDATOPT_checksums: log2 of the number of data bytes in each checksummed chunk
    uint64_t tstart;                 // time of the next sample in nanoseconds, relative to the start of the tape
 };
+#define TBIN_PLANAR_LOG2 12         // the planar group size we write: 4096 samples per track
+#define TBIN_PLANAR_MAXLOG2 16      // the biggest planar group size we will read
+#define TBIN_CHECKSUM_LOG2 20       // the checksum chunk size we write: 1 MB
+#define TBIN_CHECKSUM_MINLOG2 12    // the smallest and biggest checksum chunk sizes we will read
+#define TBIN_CHECKSUM_MAXLOG2 30
 // What follows are multiple sets of "ntrks" packed little-endian signed integers,
 // in the track (head) order msb..lsb,parity.
 // Each integer is "sample_bits" long, and encodes the read head voltage for a sample in the range
@@ -90,6 +98,35 @@ struct tbin_dat_t {     // the data header that starts each block of data
 // To mark the end is the single value -2^(sample_bits-1), which is outside that range.
 //    (For sample_bits=16, that's -32768, or 0x8000.)
 // After that there can (in theory) be more tbin_dat structures, or the end of the file.
+// If TDATOPT_planar is set, the samples are instead stored in groups of n=2^planar_log2 samples:
+// n consecutive samples for track 0, then n for track 1, etc. The last group is shorter: the k<n
+// samples for track 0 are followed by the end marker, then k samples for each of the other tracks.
+// (If the data fills the last group exactly, that's followed by a group that is just the end marker.)
+// Reading the voltages of only some tracks, or of a track over time, is then a contiguous access.
+// If TDATOPT_checksums is set, the data bytes that follow tbin_dat, up to and including the end
+// marker, are divided into chunks of 2^checksum_log2 bytes, of which the last can be shorter.
+// After the end marker is a 4-byte little-endian CRC-32 (the IEEE 802.3 polynomial, as used by
+// zip and Ethernet) for each chunk, and then the tbin_chk trailer as the last 16 bytes of the file.
+// The trailer lets the chunks be found and checked independently, and in parallel, without
+// reading the samples first. (This only works for files with a single tbin_dat block.)
+
+struct tbin_chk_t {     // the trailer at the end of a file with TDATOPT_checksums
+   uint64_t datasize;               // the number of data bytes, including the end marker
+   uint32_t nchunks;                // the number of chunk checksums that precede this trailer
+   char tag[4];                     // a zero-terminated ASCII string identifier tag
+#define CHK_TAG "CHK"
+};
+
+static inline uint32_t crc_update(uint32_t crc, const uint8_t *buf, size_t len) { // continue a chunk CRC-32 that started as 0
+   static uint32_t table[256] = { 0 };
+   if (table[1] == 0) // make the table for the reflected IEEE 802.3 polynomial
+      for (uint32_t i = 0; i < 256; ++i) {
+         uint32_t c = i;
+         for (int bit = 0; bit < 8; ++bit) c = c & 1 ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+         table[i] = c; }
+   crc = ~crc;
+   while (len--) crc = table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+   return ~crc; }
 
 // portability assumptions not otherwise explicit in the types:
 //  - numeric fields are externally stored as little-endian, and are converted when necessary
@@ -35,6 +35,14 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define DUMP_DATA_1BIT false   // if so, only write data with a single 1-bit?
 
 static int gcr_bitnum, gcr_bytenum;
+bool gcr_bad_bytes[MAXBLOCK + 1]; // which decoded bytes are in a dgroup whose parity or ECC errors weren't corrected
+
+// for -viterbi, the peak intervals on each track that the sequence detector will look at at the end of the block
+static float ml_interval[9][MAXBLOCK]; // the interval before each peak, in bit spaces, after the pulse adjustment
+static byte ml_numbits[9][MAXBLOCK];   // how many bits gcr_checkzeros() decided that was
+static bool ml_weak[9][MAXBLOCK];      // were those bits weak?
+static int ml_start[9];                // the datacount where the first interval's bits start
+static int ml_count[9];                // how many intervals there are
 
 #if DUMP_PEAKDATA
 #define MAXPEAKS 10000
@@ -124,7 +132,7 @@ static byte dot2(uint64_t x, uint64_t y, int w) {
       x >>= 1; }
    return (d & 1); }
 
-static byte gcr_compute_ecc(void) { // Compute the expected ECC of the 7 data bytes sitting before the ECC byte we just stored.
+static byte gcr_ecc_of(uint16_t *dgroup) { // Compute the expected ECC of the 7 data bytes of a dgroup
    static uint64_t A[] = {
       0x0f6a71994c5230ULL,
       0x70110840108004ULL,
@@ -136,13 +144,16 @@ static byte gcr_compute_ecc(void) { // Compute the expected ECC of the 7 data by
       0x5d5a7011084010ULL };
    uint64_t dblock = 0;
    // gather the 7 data bytes before the ECC, without the parity bits, as one 56-bit big-endian integer
-   for (int i = 8; i > 1; --i)
-      dblock = (dblock << 8) | (data[gcr_bytenum - i] >> 1);
+   for (int i = 0; i < 7; ++i)
+      dblock = (dblock << 8) | (dgroup[i] >> 1);
    byte ecc = 0;
    for (int i = 0; i < 8; ++i) // generate the ECC
       ecc |= dot2(dblock, A[i], 56) << i;
    return ecc; }
 
+static byte gcr_compute_ecc(void) { // Compute the expected ECC of the 7 data bytes sitting before the ECC byte we just stored.
+   return gcr_ecc_of(&data[gcr_bytenum - 8]); }
+
 //**** error correction using the ECC
 
 // This expects the bit ordering within the 16-bit word to be (p)(msb)...(lsb),
@@ -326,7 +337,7 @@ bool correct_errors(uint16_t *dblock, uint16_t bad_tracks) {
       e1p = e2p ^ S1p;
       //apply corrections
       //this method does not require the data array to be transposed
-      for (i = 0; i <= 8; i++) {
+      for (i = 0; i < 8; i++) { // (the error patterns are only 8 bits, and B has only 8 entries)
          Corr_i = e1p & (uint8_t)(1 << i);
          B[i] ^= (Corr_i != 0) << pi;
          Corr_i = e2p & (uint8_t)(1 << i);
@@ -408,6 +419,7 @@ void gcr_savedata(void) { // save data with ECC for writing to a file later
 void gcr_preprocess(void) {   // setup for processing of a block
    struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
    gcr_bitnum = gcr_bytenum = 0;
+   memset(ml_count, 0, sizeof(ml_count));
    result->first_error = -1; }
 
 /********************************************************************************************
@@ -443,7 +455,9 @@ char *gcr_sgroup_name[32] = { // display names of the GCR 5-bit storage codes
    "SYNC" };
 
 static byte gcr_sgroup[9]; // 5-bit codes for tracks 0..8
+static uint16_t gcr_sgroup_weak; // which tracks had low-confidence bits in those codes
 static int bad_parity_in_dgroup;
+static uint16_t erasures_in_dgroup; // which tracks are suspect in this dgroup, in data[] order
 
 void gcr_bad_subgroup(int trk, const char *msg) {
    struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
@@ -455,7 +469,9 @@ void gcr_get_sgroups(void) {
    int bitnum, trk;
    uint16_t dataword;
    struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
+   gcr_sgroup_weak = 0;
    for (bitnum = 0; bitnum < 5; ++bitnum) {
+      gcr_sgroup_weak |= data_weak[gcr_bitnum + bitnum];
       dataword = data[gcr_bitnum + bitnum];
       trk = 9; do {
          gcr_sgroup[trk - 1] = (gcr_sgroup[trk - 1] << 1) & (byte)0x1f | (dataword & 1);
@@ -471,10 +487,12 @@ void gcr_store_dgroups(bool groupa) {
    int bitnum, trk;
    uint16_t mask;
    byte nibble;
+   erasures_in_dgroup |= gcr_sgroup_weak;
    trk = 8; mask = 1; do {
       nibble = gcr_datamap[gcr_sgroup[trk]];
       if (nibble >= 16) { // bad code
          gcr_bad_subgroup(trk, "invalid 5-bit code");
+         erasures_in_dgroup |= mask;
          nibble -= 16; } // nibble-16 is the closest in Hamming distance
       bitnum = 3; do {
          if (nibble & 1)
@@ -493,6 +511,253 @@ void gcr_store_dgroups(bool groupa) {
          if (result->first_error < 0) result->first_error = gcr_bytenum + bitnum; } }
    gcr_bytenum += 4; }
 
+bool gcr_correct_erasures(bool ecc_bad) {
+   // If exactly two tracks of the dgroup we just stored are suspect because they had invalid 5-bit codes or
+   // low-confidence bits, use them as pointers for two-track ECC correction. Two pointers use up all the
+   // redundancy, so the parity and ECC checks afterwards will almost always pass; that's why we only do this
+   // when blind correction of one track has failed, and only for tracks we have independent reasons to doubt.
+   // (That's also why the track nominated by the track health model isn't used here: it says nothing about this dgroup.)
+   struct results_t *result = &block.results[block.parmset];
+   uint16_t saved[8], tom_order[8], my_order, changed_tracks = 0;
+   uint16_t pointers = erasures_in_dgroup, tracks = pointers;
+   int count, changed = 0;
+   COUNTBITS(count, tracks);
+   if (count != 2) return false;
+   for (int i = 0; i < 8; ++i) { //convert to p(msb)...(lsb)
+      my_order = saved[i] = data[gcr_bytenum - 8 + i];
+      tom_order[i] = ((my_order >> 1) & 0xff) | ((my_order & 0x01) << 8); }
+   if (correct_errors(tom_order, ((pointers >> 1) & 0xff) | ((pointers & 0x01) << 8))) {
+      bool parity_ok = true;
+      for (int i = 0; i < 8; ++i) { //convert back to (msb)...(lsb)p
+         data[gcr_bytenum - 8 + i] = my_order = ((tom_order[i] & 0xff) << 1) | (tom_order[i] >> 8);
+         if (parity(my_order) != expected_parity) parity_ok = false;
+         changed_tracks |= my_order ^ saved[i];
+         for (uint16_t diff = my_order ^ saved[i]; diff; diff &= diff - 1) ++changed; }
+      if (parity_ok && changed > 0 && gcr_compute_ecc() == data[gcr_bytenum - 1] >> 1) {
+         if (debug_level & DB_GCRERRS) dlog("  corrected %d bits on tracks %03X using erasure pointers\n", changed, pointers);
+         result->corrected_bits += changed;
+         result->faked_tracks |= changed_tracks;
+         if (ecc_bad) --result->ecc_errs; // because the ECC is now right
+         return true; }
+      memcpy(&data[gcr_bytenum - 8], saved, sizeof(saved)); } // it didn't work, so restore the data
+   return false; }
+
+// what gcr_check_dgroup() saw and counted for the last dgroup, in case it is saved for repair using the block CRC
+static uint16_t dgroup_asread[8];
+static int dgroup_ecc_errs, dgroup_vparity_errs;
+
+bool gcr_check_dgroup(void) {
+   // Check the parity and ECC of the 8-byte dgroup we just stored, and correct it if we can.
+   // Return true if it is still bad.
+   struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
+   memcpy(dgroup_asread, &data[gcr_bytenum - 8], sizeof(dgroup_asread));
+   dgroup_ecc_errs = result->ecc_errs;
+   dgroup_vparity_errs = result->vparity_errs;
+   bool ecc_bad = gcr_compute_ecc() != data[gcr_bytenum - 1] >> 1;
+   if (ecc_bad) { // see if ECC is ok
+      if (debug_level & DB_GCRERRS) dlog("ecc bad in dgroup ending at byte %d\n", gcr_bytenum - 1);
+      ++result->ecc_errs;
+      if (result->first_error < 0) result->first_error = gcr_bytenum - 1; }
+   if (do_correction && ecc_bad && !bad_parity_in_dgroup) // errors in two tracks of the same bytes hide from parity
+      gcr_correct_erasures(ecc_bad);
+   if (bad_parity_in_dgroup) { // see if there were any parity errors in these 8 bytes
+      uint16_t my_order, tom_order[8];
+      if (debug_level & DB_GCRERRS) {
+         dlog("%d parity errors in dgroup ending at byte %d from time %.8lf:", bad_parity_in_dgroup, gcr_bytenum - 1, data_time[gcr_bytenum-1]);
+         for (int i = 0; i < 8; ++i) {
+            my_order = data[gcr_bytenum - 8 + i];
+            dlog("  %02X %d", my_order >> 1, my_order & 1); }
+         dlog("\n"); }
+      if (do_correction) {
+         for (int i = 0; i < 8; ++i) { //convert to p(msb)...(lsb)
+            my_order = data[gcr_bytenum - 8 + i];
+            tom_order[i] = ((my_order >> 1) & 0xff) | ((my_order & 0x01) << 8); }
+         if (correct_errors(tom_order, 0x01)) {
+            if (debug_level & DB_GCRERRS) dlog("  as corrected using the ecc: ");
+            bad_parity_in_dgroup = 0;
+            for (int i = 0; i < 8; ++i) { //convert back to (msb)...(lsb)p
+               my_order = ((tom_order[i] & 0xff) << 1) | (tom_order[i] >> 8);
+               result->faked_tracks |= my_order ^ data[gcr_bytenum - 8 + i];
+               data[gcr_bytenum - 8 + i] = my_order;
+               if (debug_level & DB_GCRERRS) dlog("  %02X %d", my_order >> 1, my_order & 1);
+               if (parity(my_order) != expected_parity) ++bad_parity_in_dgroup; }
+            if (debug_level & DB_GCRERRS) dlog("\n  now there are %d parity errors in the dgroup\n", bad_parity_in_dgroup);
+            ++result->corrected_bits;
+            if (gcr_compute_ecc() == data[gcr_bytenum - 1] >> 1) {
+               if (debug_level & DB_GCRERRS) dlog("  and the ecc is now correct\n");
+               if (ecc_bad) --result->ecc_errs; }
+            else {
+               if (debug_level & DB_GCRERRS) dlog("  but the ecc is now wrong!?!\n");
+               ++result->ecc_errs; } }
+         else if (gcr_correct_erasures(ecc_bad)) // blind correction of one track didn't work, so try two suspect tracks
+            bad_parity_in_dgroup = 0;
+         else {
+            if (debug_level & DB_GCRERRS) dlog("did not correct error\n"); } }
+      result->vparity_errs += bad_parity_in_dgroup; }
+   dgroup_ecc_errs = result->ecc_errs - dgroup_ecc_errs;
+   dgroup_vparity_errs = result->vparity_errs - dgroup_vparity_errs;
+   return bad_parity_in_dgroup // (if there was no correction, the ECC status hasn't changed)
+          || ((ecc_bad || do_correction) && gcr_compute_ecc() != data[gcr_bytenum - 1] >> 1); }
+
+//**** repair of uncorrectable dgroups using the block CRC
+
+#define GCR_MAXREPAIR 4    // the most uncorrectable dgroups in a block that we try to repair
+#define GCR_MAXCOMBOS 64   // the most combinations of their candidate corrections we try; a 9-bit CRC can't pick among more
+
+static struct gcr_baddgroup_t { // a dgroup whose parity or ECC errors weren't corrected
+   int start;                  // where its 7 data bytes are in data[]
+   uint16_t asread[8];         // its data and ECC bytes before we tried to correct them
+   uint16_t erasures;          // its suspect tracks, in data[] order
+   int ecc_errs, vparity_errs; // the errors we counted for it
+   int numcands;               // the corrections that satisfy its parity and ECC:
+   uint16_t cands[36][7];      //   the corrected data bytes
+   int crc_deltas[36]; }       //   how each changes the block CRC
+gcr_baddgroups[GCR_MAXREPAIR];
+static int gcr_num_baddgroups;
+
+static void gcr_save_baddgroup(void) { // remember the dgroup that gcr_check_dgroup() just said is still bad
+   if (gcr_num_baddgroups++ >= GCR_MAXREPAIR) return; // too many to repair; just count them
+   struct gcr_baddgroup_t *bd = &gcr_baddgroups[gcr_num_baddgroups - 1];
+   bd->start = gcr_bytenum - 8;
+   memcpy(bd->asread, dgroup_asread, sizeof(bd->asread));
+   bd->erasures = erasures_in_dgroup;
+   bd->ecc_errs = dgroup_ecc_errs;
+   bd->vparity_errs = dgroup_vparity_errs; }
+
+int gcr_compute_crc(uint16_t *bytes, int dgroups) {
+   // Compute the block CRC char C. It is the same 9-bit CRC as for 9-track 800 BPI NRZI, over the data bytes (but not
+   // the dgroup ECCs), the six bytes of the residual group and its auxiliary CRC char N, and then the zero pad char B
+   // if there is an even number of full data groups. That's what matches all the blocks of the GCR example tapes.
+   int crc = 0;
+   for (int i = 0; i < 7 * dgroups + 7; ++i) crc = nrzi_crc_step(crc, bytes[i]);
+   if (!(dgroups & 1)) crc = nrzi_crc_step(crc, 0x001); // zero, with odd parity
+   return crc ^ 0x1af; }
+
+static int gcr_crc_delta(int start, uint16_t *newdata, int crclength) {
+   // How the block CRC changes if the 7 data bytes at "start" are replaced. The CRC is linear,
+   // so that is the CRC, without the final inversion, of the changed bits followed by zeroes.
+   int crc = 0;
+   for (int i = start; i < crclength; ++i)
+      crc = nrzi_crc_step(crc, i < start + 7 ? newdata[i - start] ^ data[i] : 0);
+   return crc; }
+
+static void gcr_repair_candidates(struct gcr_baddgroup_t *bd, int crclength) {
+   // Find the distinct corrections of a bad dgroup that assume errors in two tracks and satisfy the parity and ECC.
+   // If some tracks of the dgroup are suspect, one of the two must be; otherwise we try all 36 pairs.
+   bd->numcands = 0;
+   for (int trk1 = 0; trk1 < 9; ++trk1)
+      for (int trk2 = trk1 + 1; trk2 < 9; ++trk2) {
+         uint16_t pointers = (1 << trk1) | (1 << trk2), tom_order[8], fixed[8];
+         if (bd->erasures && !(pointers & bd->erasures)) continue;
+         for (int i = 0; i < 8; ++i) //convert to p(msb)...(lsb)
+            tom_order[i] = ((bd->asread[i] >> 1) & 0xff) | ((bd->asread[i] & 0x01) << 8);
+         if (!correct_errors(tom_order, ((pointers >> 1) & 0xff) | ((pointers & 0x01) << 8))) continue;
+         bool ok = true;
+         for (int i = 0; i < 8; ++i) { //convert back to (msb)...(lsb)p
+            fixed[i] = ((tom_order[i] & 0xff) << 1) | (tom_order[i] >> 8);
+            if (parity(fixed[i]) != expected_parity) ok = false; }
+         if (!ok || gcr_ecc_of(fixed) != fixed[7] >> 1) continue;
+         for (int c = 0; c < bd->numcands && ok; ++c)
+            if (memcmp(bd->cands[c], fixed, sizeof(bd->cands[c])) == 0) ok = false; // we already have it
+         if (!ok) continue;
+         memcpy(bd->cands[bd->numcands], fixed, sizeof(bd->cands[0]));
+         bd->crc_deltas[bd->numcands++] = gcr_crc_delta(bd->start, fixed, crclength); } }
+
+static bool gcr_repair_dgroups(int crclength, int syndrome) {
+   // The block CRC is wrong by "syndrome", and some dgroups couldn't be corrected using their ECC. Try all
+   // combinations of their candidate corrections, and if exactly one combination makes the CRC right, use it.
+   struct results_t *result = &block.results[block.parmset];
+   int combos = 1, matches = 0, choice[GCR_MAXREPAIR];
+   for (int g = 0; g < gcr_num_baddgroups; ++g) {
+      gcr_repair_candidates(&gcr_baddgroups[g], crclength);
+      combos *= gcr_baddgroups[g].numcands;
+      if (combos == 0 || combos > GCR_MAXCOMBOS) {
+         if (debug_level & DB_GCRERRS) dlog("  too many or no candidate corrections to repair %d bad dgroups\n", gcr_num_baddgroups);
+         return false; } }
+   for (int combo = 0; combo < combos; ++combo) {
+      int delta = 0;
+      for (int g = 0, n = combo; g < gcr_num_baddgroups; ++g) {
+         delta ^= gcr_baddgroups[g].crc_deltas[n % gcr_baddgroups[g].numcands];
+         n /= gcr_baddgroups[g].numcands; }
+      if (delta == syndrome && ++matches == 1)
+         for (int g = 0, n = combo; g < gcr_num_baddgroups; ++g) {
+            choice[g] = n % gcr_baddgroups[g].numcands;
+            n /= gcr_baddgroups[g].numcands; } }
+   if (debug_level & DB_GCRERRS) dlog("  %d of %d combinations of corrections to %d bad dgroups make the CRC right\n",
+                                         matches, combos, gcr_num_baddgroups);
+   if (matches != 1) return false;
+   for (int g = 0; g < gcr_num_baddgroups; ++g) {
+      struct gcr_baddgroup_t *bd = &gcr_baddgroups[g];
+      for (int i = 0; i < 7; ++i) {
+         uint16_t changed = bd->cands[choice[g]][i] ^ data[bd->start + i];
+         result->faked_tracks |= changed;
+         for (; changed; changed &= changed - 1) ++result->corrected_bits;
+         data[bd->start + i] = bd->cands[choice[g]][i];
+         gcr_bad_bytes[bd->start + i] = false; }
+      result->ecc_errs -= bd->ecc_errs;
+      result->vparity_errs -= bd->vparity_errs; }
+   return true; }
+
+static bool gcr_residual_plausible(uint16_t *res, int count) { // could "count" bytes of the residual group be data?
+   if (count > 6) return false; // the 7th byte is always the auxiliary CRC
+   for (int i = count; i < 6; ++i)
+      if (res[i] >> 1 != 0) return false; // pad bytes must be zero
+   return true; }
+
+int gcr_check_trailer(bool residual_bad) {
+   // Verify the residual group (HHHHHH N E) and the CRC group (B CCCCC X E) that end the block, after
+   // they have been checked and perhaps corrected using their own ECC, and return how many of the
+   // residual bytes are data. The redundancy we can check is:
+   //  - the five copies of the CRC char C must agree, and C must be the CRC of the block
+   //  - the pad char B is C if there is an odd number of full data groups, and 0 otherwise
+   //  - the residual char X has the residual count in its top 3 bits and the low 5 bits of (length - 1)
+   //  - residual bytes that aren't data are zero
+   // If the CRC is wrong and there are a few dgroups that the ECC couldn't correct, we try to repair them.
+   // If the two halves of X disagree, we believe the one that is plausible. We don't check the auxiliary
+   // CRC char N, because we haven't been able to work out how it is computed from the example tapes.
+   struct results_t *result = &block.results[block.parmset];
+   uint16_t *res = &data[gcr_bytenum - 16], *crc = &data[gcr_bytenum - 8];
+   int dgroups = (gcr_bytenum - 16) / 7; // full data groups, now without their ECC
+   int errs = 0, votes = 0;
+   uint16_t crcchar = 0;
+   for (int i = 1; i <= 5; ++i) { // take the majority of the copies of the CRC char
+      int agree = 0;
+      for (int j = 1; j <= 5; ++j)
+         if (crc[j] == crc[i]) ++agree;
+      if (agree > votes) {
+         votes = agree;
+         crcchar = crc[i]; } }
+   if (votes < 5) ++errs;
+   result->crc = crcchar; // (for -vote, which checks the CRC of the block it assembles)
+   result->lrc = res[6];
+   int syndrome = gcr_compute_crc(data, dgroups) ^ crcchar;
+   if (syndrome) {
+      if (debug_level & DB_GCRERRS) dlog("block CRC is %03X, should be %03X, with %d bad dgroups\n",
+                                            crcchar, crcchar ^ syndrome, gcr_num_baddgroups);
+      if (do_correction && votes >= 3 && gcr_num_baddgroups > 0 && gcr_num_baddgroups <= GCR_MAXREPAIR
+            && gcr_repair_dgroups(7 * dgroups + 7 + !(dgroups & 1), syndrome)) {
+         if (debug_level & DB_GCRERRS) dlog("  repaired %d bad dgroups using the CRC\n", gcr_num_baddgroups);
+         residual_bad = false; }
+      else ++errs; }
+   if (crc[0] >> 1 != (dgroups & 1 ? crcchar >> 1 : 0)) ++errs;
+   byte xchar = crc[6] >> 1;
+   int count_hi = xchar >> 5;
+   int count_lo = ((xchar & 0x1f) - 7 * dgroups + 1) & 0x1f; // the residual count that makes the length right
+   int residual_count = count_hi;
+   if (count_hi != count_lo) {
+      ++errs;
+      if (!gcr_residual_plausible(res, count_hi) && gcr_residual_plausible(res, count_lo))
+         residual_count = count_lo; }
+   if (!gcr_residual_plausible(res, residual_count)) ++errs;
+   if (residual_count > 6) residual_count = 6;
+   if (errs) {
+      if (debug_level & DB_GCRERRS) dlog("%d errors in residual/CRC groups after %d dgroups: C %02X, %d votes, B %02X, X %02X\n",
+                                            errs, dgroups, crcchar >> 1, votes, crc[0] >> 1, xchar);
+      result->crc_errs += errs;
+      if (result->first_error < 0) result->first_error = gcr_bytenum - 16; }
+   for (int i = 0; i < residual_count; ++i) gcr_bad_bytes[gcr_bytenum - 16 + i] = residual_bad;
+   return residual_count; }
+
 enum gcr_state_t { // state machine for decoding blocks
    GCR_preamble, GCR_data_A, GCR_data_B, GCR_resync, GCR_residual_A, GCR_residual_B, GCR_crc_A, GCR_crc_B, GCR_postamble };
 
@@ -526,9 +791,12 @@ void gcr_postprocess(void) {
    eccdatacount = 0;
    result->blktype = BS_BLOCK;
    result->first_error = -1;
+   memset(gcr_bad_bytes, 0, result->maxbits * sizeof(gcr_bad_bytes[0])); // (the decoded data is always shorter)
    gcr_bitnum = 0;   // where we read from in data[]
    enum gcr_state_t state = GCR_preamble;
    bool groupa = true;
+   bool residual_bad = false;
+   gcr_num_baddgroups = 0;
 #if SHOW_GCRDATA
    rlog("  data counts:");
    for (int trk = 0; trk < 9; ++trk) rlog("%10d", trkstate[trk].datacount);
@@ -563,6 +831,7 @@ void gcr_postprocess(void) {
             state = GCR_residual_A; }
          else {
             bad_parity_in_dgroup = 0;
+            erasures_in_dgroup = 0;
             gcr_store_dgroups(GROUPA);
             state = GCR_data_B; }
          break;
@@ -573,40 +842,9 @@ void gcr_postprocess(void) {
 #if DUMP_DATA
          gcr_savedata();
 #endif
-         struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
-         if (gcr_compute_ecc() != data[gcr_bytenum - 1] >> 1) { // see if ECC is ok
-            if (debug_level & DB_GCRERRS) dlog("ecc bad in dgroup ending at byte %d\n", gcr_bytenum - 1);
-            ++result->ecc_errs;
-            if (result->first_error < 0) result->first_error = gcr_bytenum - 1; }
-         if (bad_parity_in_dgroup) { // see if there were any parity errors in these 8 bytes
-            uint16_t my_order, tom_order[8];
-            if (debug_level & DB_GCRERRS) {
-               dlog("%d parity errors in dgroup ending at byte %d from time %.8lf:", bad_parity_in_dgroup, gcr_bytenum - 1, data_time[gcr_bytenum-1]);
-               for (int i = 0; i < 8; ++i) {
-                  my_order = data[gcr_bytenum - 8 + i];
-                  dlog("  %02X %d", my_order >> 1, my_order & 1); }
-               dlog("\n"); }
-            if (do_correction) {
-               for (int i = 0; i < 8; ++i) { //convert to p(msb)...(lsb)
-                  my_order = data[gcr_bytenum - 8 + i];
-                  tom_order[i] = ((my_order >> 1) & 0xff) | ((my_order & 0x01) << 8); }
-               if (correct_errors(tom_order, 0x01)) {
-                  if (debug_level & DB_GCRERRS) dlog("  as corrected using the ecc: ");
-                  bad_parity_in_dgroup = 0;
-                  for (int i = 0; i < 8; ++i) { //convert back to (msb)...(lsb)p
-                     data[gcr_bytenum - 8 + i] = my_order = ((tom_order[i] & 0xff) << 1) | (tom_order[i] >> 8);
-                     if (debug_level & DB_GCRERRS) dlog("  %02X %d", my_order >> 1, my_order & 1);
-                     if (parity(my_order) != expected_parity) ++bad_parity_in_dgroup; }
-                  if (debug_level & DB_GCRERRS) dlog("\n  now there are %d parity errors in the dgroup\n", bad_parity_in_dgroup);
-                  ++result->corrected_bits;
-                  if (gcr_compute_ecc() == data[gcr_bytenum - 1] >> 1) {
-                     if (debug_level & DB_GCRERRS) dlog("  and the ecc is still correct\n") }
-                  else {
-                     if (debug_level & DB_GCRERRS) dlog("  but the ecc is now wrong!?!\n");
-                     ++result->ecc_errs; } }
-               else {
-                  if (debug_level & DB_GCRERRS) dlog("did not correct error\n"); } }
-            result->vparity_errs += bad_parity_in_dgroup; }
+         bool dgroup_bad = gcr_check_dgroup();
+         for (int i = gcr_bytenum - 8; i < gcr_bytenum - 1; ++i) gcr_bad_bytes[i] = dgroup_bad;
+         if (dgroup_bad) gcr_save_baddgroup(); // maybe the block CRC can fix it later
          gcr_bytenum -= 1; // remove ECC
          state = GCR_data_A;
          break;
@@ -619,6 +857,8 @@ void gcr_postprocess(void) {
          break;
 
       case GCR_residual_A:
+         bad_parity_in_dgroup = 0;
+         erasures_in_dgroup = 0;
          gcr_store_dgroups(GROUPA);
          state = GCR_residual_B;
          break;
@@ -626,10 +866,14 @@ void gcr_postprocess(void) {
       case GCR_residual_B:
          gcr_store_dgroups(GROUPB);
          gcr_showdata("residual");  // HHHH HHNE; leave all 8 bytes there, temporarily
+         residual_bad = gcr_check_dgroup();
+         if (residual_bad) gcr_save_baddgroup();
          state = GCR_crc_A;
          break;
 
       case GCR_crc_A:
+         bad_parity_in_dgroup = 0;
+         erasures_in_dgroup = 0;
          gcr_store_dgroups(GROUPA);
          state = GCR_crc_B;
          break;
@@ -637,8 +881,8 @@ void gcr_postprocess(void) {
       case GCR_crc_B:
          gcr_store_dgroups(GROUPB);
          gcr_showdata("crc"); // BCCC CCXE
-         // insert crc processing here
-         int residual_count = data[gcr_bytenum - 2] /* "residual char" (X) in CRC group */ >> (5 + 1) /* includes parity! */;
+         gcr_check_dgroup();
+         int residual_count = gcr_check_trailer(residual_bad);
          if (SHOW_GCRDATA) rlog("residual char = %02X; adding %d of the residual bytes\n", data[gcr_bytenum - 2] >> 1, residual_count);
          // remove the residual and crc data groups from the data, except for any valid residual bytes
          gcr_bytenum -= (16 - residual_count);
@@ -669,6 +913,10 @@ void gcr_postprocess(void) {
    rlog("\n");
 #endif
 #endif
+   if (state != GCR_preamble && state != GCR_postamble) { // the data ended before the residual and CRC groups were checked
+      if (debug_level & DB_GCRERRS) dlog("block ended in state %d, without the residual and CRC groups\n", state);
+      ++result->crc_errs;
+      if (result->first_error < 0) result->first_error = gcr_bytenum; }
    result->minbits = result->maxbits = gcr_bytenum;
    interblock_counter = (int)(GCR_IBG_SECS / sample_deltat);  // ignore data for a while until we're well into the IBG
 }
@@ -679,12 +927,101 @@ void show_clock_averages(void) {
       rlog("%4d:%.2f ", trkstate[trk].datacount, trkstate[trk].clkavg.t_bitspaceavg*1e6);
    rlog("\n"); }
 
+/********************************************************************************************
+   maximum-likelihood sequence detection, for -viterbi
+
+   gcr_checkzeros() decides by itself how many zeroes come before each peak, using the z1pt
+   and z2pt thresholds. But each track's 5-bit storage subgroups can only be one of the 16 data
+   codes or the few special codes, so some of those decisions can be overruled. With -viterbi
+   we remember the interval before each peak, and at the end of the block we use the Viterbi
+   algorithm to find, for each track, the sequence of zero counts that makes only valid
+   subgroups and whose expected intervals are closest to the ones we measured. The expected
+   intervals are placed so that the thresholds are halfway between them, which means that
+   without the subgroup constraint we would make the same decisions. Bits that we change are
+   marked as weak, so they can be used as erasures by error correction.
+********************************************************************************************/
+
+#define ML_STATES 32    // a partial subgroup of 0 to 4 bits, stored as a 1 followed by the bits
+
+static byte ml_next[ML_STATES][4]; // the state after adding n-1 zeroes and a one, or 0 if that makes a bad subgroup
+static byte ml_from[MAXBLOCK][ML_STATES]; // the best previous state, and (in the top bits) the number of bits
+static byte ml_path[MAXBLOCK];     // the number of bits for each interval on the best path
+
+static void gcr_ml_init(void) { // compute the trellis of valid subgroups
+   bool valid[32];
+   for (int code = 0; code < 32; ++code)
+      valid[code] = gcr_datamap[code] < 16 || code == GCR_MARK1 || code == GCR_MARK2 || code == GCR_SYNC || code == GCR_TERML0;
+   for (int state = 1; state < ML_STATES; ++state)
+      for (int numbits = 1; numbits <= 3; ++numbits) {
+         int next = state;
+         for (int bit = 1; bit <= numbits && next != 0; ++bit) {
+            next = next << 1 | (bit == numbits);
+            if (next >= 32) next = valid[next & 0x1f] ? 1 : 0; } // a complete subgroup
+         ml_next[state][numbits] = (byte)next; } }
+
+static void gcr_ml_record(struct trkstate_t *t, float interval, int numbits) { // remember a peak interval for the sequence detector
+   int trk = t->trknum;
+   if (ml_count[trk] >= MAXBLOCK) return;
+   if (ml_count[trk] == 0) ml_start[trk] = t->datacount - (numbits - 1); // (the zeroes have already been added)
+   ml_interval[trk][ml_count[trk]] = interval;
+   ml_numbits[trk][ml_count[trk]] = (byte)numbits;
+   ml_weak[trk][ml_count[trk]] = t->confidence < WEAK_CONFIDENCE;
+   ++ml_count[trk]; }
+
+static void gcr_ml_detect(struct trkstate_t *t) { // find the most likely valid bits for one track, and rewrite them
+   static bool initialized = false;
+   if (!initialized) {
+      gcr_ml_init();
+      initialized = true; }
+   int trk = t->trknum, count = ml_count[trk], start = ml_start[trk];
+   if (count == 0) return;
+   uint16_t mask = 1 << (ntrks - 1 - trk);
+   int state = 1;  // start with the partial subgroup before the first interval
+   for (int ndx = start - start % 5; ndx < start; ++ndx) state = state << 1 | ((data[ndx] & mask) != 0);
+   float expected[4] = { 0, 1, 2 * PARM.z1pt - 1, 0 }; // the interval we expect for each number of bits
+   expected[3] = 2 * PARM.z2pt - expected[2];
+   float metric[ML_STATES], newmetric[ML_STATES];
+   for (int s = 0; s < ML_STATES; ++s) metric[s] = FLT_MAX;
+   metric[state] = 0;
+   for (int i = 0; i < count; ++i) { // extend the best paths by one interval
+      for (int s = 0; s < ML_STATES; ++s) newmetric[s] = FLT_MAX;
+      for (int s = 1; s < ML_STATES; ++s)
+         if (metric[s] < FLT_MAX)
+            for (int numbits = 1; numbits <= 3; ++numbits) {
+               int next = ml_next[s][numbits];
+               float diff = ml_interval[trk][i] - expected[numbits];
+               if (next != 0 && metric[s] + diff * diff < newmetric[next]) {
+                  newmetric[next] = metric[s] + diff * diff;
+                  ml_from[i][next] = (byte)(s | numbits << 5); } }
+      memcpy(metric, newmetric, sizeof(metric)); }
+   int best = 0; // the partial subgroup at the end can be anything
+   for (int s = 1; s < ML_STATES; ++s)
+      if (metric[s] < FLT_MAX && (best == 0 || metric[s] < metric[best])) best = s;
+   if (best == 0) return; // there isn't any valid sequence, so leave it as it was
+   int changes = 0;
+   for (int i = count - 1; i >= 0; --i) { // trace the best path backwards
+      ml_path[i] = ml_from[i][best] >> 5;
+      best = ml_from[i][best] & 0x1f;
+      if (ml_path[i] != ml_numbits[trk][i]) ++changes; }
+   if (changes == 0) return;
+   dlog("trk %d: the sequence detector changed %d of %d zero counts\n", trk, changes, count);
+   block.results[block.parmset].gcr_ml_changes += changes;
+   int ndx = start;
+   for (int i = 0; i < count && ndx < MAXBLOCK; ++i) { // rewrite the track's bits from the best path
+      bool weak = ml_weak[trk][i] || ml_path[i] != ml_numbits[trk][i];
+      for (int bit = 1; bit <= ml_path[i] && ndx < MAXBLOCK; ++bit, ++ndx) {
+         data[ndx] = bit == ml_path[i] ? data[ndx] | mask : data[ndx] & ~mask;
+         mark_weak_bit(t, ndx, weak); } }
+   t->datacount = ndx; }
+
 void gcr_end_of_block(void) {
    if (block.endblock_done) return;
    block.endblock_done = true;
 
    //show_clock_averages();
    struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
+   if (do_viterbi)
+      for (int trk = 0; trk < ntrks; ++trk) gcr_ml_detect(&trkstate[trk]);
    float avg_bit_spacing = 0;
    result->minbits = MAXBLOCK;
    result->maxbits = 0;
@@ -756,6 +1093,7 @@ void gcr_addbit(struct trkstate_t *t, byte bit, double t_bit) { // add a GCR bit
                                           timenow, TICK(timenow), t->clkavg.t_bitspaceavg*1e6, t->agc_gain);
    uint16_t mask = 1 << (ntrks - 1 - t->trknum);  // update this track's bit in the data array
    data[t->datacount] = bit ? data[t->datacount] | mask : data[t->datacount] & ~mask;
+   mark_weak_bit(t, t->datacount, t->confidence < WEAK_CONFIDENCE); // zeroes are imputed from the timing of the next peak
    data_time[t->datacount] = t_bit;
 #if KNOW_GOODDATA // compare data to what it should be
    extern uint16_t gooddata[];
@@ -791,6 +1129,9 @@ int gcr_checkzeros(struct trkstate_t *t, float delta /* since last peak */) {
    if (t->datablock) {
       t->t_peakdeltaprev = t->t_peakdelta;
       t->t_peakdelta = delta;
+      if (learn_peakshift) // move the peak to where it would be without the shift caused by the pattern of peaks
+         delta -= peakshift_correction(t, delta > PARM.z2pt * t->clkavg.t_bitspaceavg ? 3 : delta > PARM.z1pt * t->clkavg.t_bitspaceavg ? 2 : 1,
+                                       t->clkavg.t_bitspaceavg);
       /*if (t->trknum == TRACETRK)*/ TRACE(adjpos, t->t_lastpeak + t->t_pulse_adj, UPTICK, t);
       // if this peak is a long time after the previous one, it implies one or two intervening zero bits
       if (delta - t->t_pulse_adj > PARM.z1pt * t->clkavg.t_bitspaceavg) { // add a zero bit at its imputed position
@@ -809,6 +1150,8 @@ int gcr_checkzeros(struct trkstate_t *t, float delta /* since last peak */) {
             && data[t->datacount - 2] & (1 << (ntrks - 1 - t->trknum)) // and also since the peak before that
          ) adjust_clock(&t->clkavg, t->t_peakdeltaprev, t->trknum);  // then adjust clock with delta of the 2nd of 3 consecutive 1-bits
       //if (t->datacount % 100 == 0) show_clock_averages();
+      if (do_viterbi) gcr_ml_record(t, (delta - t->t_pulse_adj) / t->clkavg.t_bitspaceavg, numbits);
+      if (learn_peakshift) peakshift_record(t, t->t_peakdelta - t->t_pulse_adj - numbits * t->clkavg.t_bitspaceavg, numbits, t->clkavg.t_bitspaceavg);
       // calculate some fraction of how much this pulse seems delayed, so we can account for that when the next pulse comes
       t->t_pulse_adj = PARM.pulse_adj * (numbits * t->clkavg.t_bitspaceavg - delta); // how much to move this peak to the right
 #if DUMP_PEAKDATA
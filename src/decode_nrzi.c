@@ -32,6 +32,55 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 /*****************************************************************************************************************************
    Well-formed block processing routines for 7-track or 9-track NRZI
 ******************************************************************************************************************************/
+int nrzi_crc_step(int crc, uint16_t val) { // add a byte to the 9-track CRC, which 6250 BPI GCR blocks also use
+   crc ^= val; // C0..C7,P  (See IBM Form A22-6862-4)
+   if (crc & 2) crc ^= 0xf0; // if P will become 1 after rotate, invert what will go into C2..C5
+   int lsb = crc & 1; // rotate all 9 bits
+   crc >>= 1;
+   if (lsb) crc |= 0x100;
+   return crc; }
+
+void nrzi_compute_crc_lrc(int length, uint16_t fixmask, int *pcrc, int *plrc) {
+   // compute the CRC and LRC of the data, after inverting the "fixmask" track bits of bytes that have bad parity
+   int crc = 0, lrc = 0;
+   for (int i = 0; i < length; ++i) {
+      uint16_t val = data[i];
+      if (fixmask && parity(val) != expected_parity) val ^= fixmask;
+      lrc ^= val;
+      crc = nrzi_crc_step(crc, val); }
+   crc ^= 0x1af; // invert all except C2 and C4; note that the CRC could be zero if the number of data bytes is odd
+   if (ntrks == 9) lrc ^= crc;  // LRC inlcudes the CRC (the manual doesn't say that!)
+   *pcrc = crc;
+   *plrc = lrc; }
+
+#if CORRECT
+bool nrzi_correct_track(void) {
+   // If a 9-track block has parity errors, see if inverting the bits of one track in all the bytes with parity errors
+   // makes both the CRC and the LRC correct. If that works for exactly one track, make the correction.
+   // If it works for several, use the one nominated by the track health model, if it's one of them.
+   struct results_t *result = &block.results[block.parmset];
+   int crc, lrc, badtrk = -1;
+   bool ambiguous = false;
+   for (int trk = 0; trk < ntrks; ++trk) {
+      nrzi_compute_crc_lrc(result->minbits, 1 << (ntrks - 1 - trk), &crc, &lrc);
+      if (crc == result->crc && lrc == result->lrc) {
+         if (health_suspect == 1 << (ntrks - 1 - trk)) {
+            badtrk = trk; break; }
+         if (badtrk >= 0) ambiguous = true; // more than one track works, so we don't know which
+         badtrk = trk; } }
+   if (badtrk < 0 || (ambiguous && health_suspect != 1 << (ntrks - 1 - badtrk))) return false;
+   uint16_t mask = 1 << (ntrks - 1 - badtrk);
+   for (int i = 0; i < result->minbits; ++i)
+      if (parity(data[i]) != expected_parity) {
+         data[i] ^= mask;
+         data_faked[i] |= mask;
+         ++result->corrected_bits; }
+   result->faked_tracks |= mask;
+   dlog("corrected %d parity errors on track %d using the CRC and LRC\n", result->vparity_errs, badtrk);
+   result->vparity_errs = result->crc_errs = result->lrc_errs = 0;
+   return true; }
+#endif
+
 void nrzi_postprocess(void) {
    struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
    //dumpdata(data, result->minbits);
@@ -52,27 +101,27 @@ void nrzi_postprocess(void) {
       result->maxbits -= 8;  // now remove those ending bytes
       result->minbits -= 8;
       set_expected_parity(result->maxbits);
-      int crc = 0, lrc = 0;
-      for (int i = 0; i < result->minbits; ++i) {  // count parity errors, and compute the CRC/LRC
+      int crc, lrc;
+#if CORRECT
+      if (do_correction) correct_parity_erasures(result->minbits, false);
+#endif
+      for (int i = 0; i < result->minbits; ++i) {  // count parity errors
          if (parity(data[i]) != expected_parity) {
             dlog("parity err in nrzi_postprocess() at index %d data %03X time %.8lf tick %.1lf\n",
                  i, data[i], data_time[i], TICK(data_time[i]));
-            ++result->vparity_errs; }
-         lrc ^= data[i];
-         crc ^= data[i]; // C0..C7,P  (See IBM Form A22-6862-4)
-         if (crc & 2) crc ^= 0xf0; // if P will become 1 after rotate, invert what will go into C2..C5
-         int lsb = crc & 1; // rotate all 9 bits
-         crc >>= 1;
-         if (lsb) crc |= 0x100; }
-      crc ^= 0x1af; // invert all except C2 and C4; note that the CRC could be zero if the number of data bytes is odd
+            ++result->vparity_errs; } }
+      nrzi_compute_crc_lrc(result->minbits, 0, &crc, &lrc);
       if (ntrks == 9) { // only 9-track tapes have CRC
-         lrc ^= crc;  // LRC inlcudes the CRC (the manual doesn't say that!)
          if (crc != result->crc) {
             ++result->crc_errs;
             dlog("crc is %03X, should be %03X\n", result->crc, crc); } }
       if (lrc != result->lrc) {
          ++result->lrc_errs;
-         dlog("lrc is %03X, should be %03X\n", result->lrc, lrc); } } }
+         dlog("lrc is %03X, should be %03X\n", result->lrc, lrc); }
+#if CORRECT
+      if (do_correction && ntrks == 9 && result->vparity_errs > 0) nrzi_correct_track();
+#endif
+   } }
 
 void nrzi_end_of_block(void) {
    struct results_t *result = &block.results[block.parmset]; // where we put the results of this decoding
@@ -96,8 +145,8 @@ void nrzi_end_of_block(void) {
    // see what we think this is, based on the length
    if ( // maybe it's a tapemark, which is pretty bizarre
       result->minbits == 9 // the initial 1-bit plus 8 bits of post-block
-      && (ntrks == 9 && data[0] == 0x26 && data[8] == 0x26  // 9 trk: trks 367, then 7 bits of zeros, then 367
-          ||  ntrks == 7 && data[0] == 0x1e && (data[3] == 0x1e || data[4] == 0x1e))) { // 7trk: trks 8421, then 2 or 3 bits of zeros, then 8421
+      && ((ntrks == 9 && data[0] == 0x26 && data[8] == 0x26)  // 9 trk: trks 367, then 7 bits of zeros, then 367
+          ||  (ntrks == 7 && data[0] == 0x1e && (data[3] == 0x1e || data[4] == 0x1e)))) { // 7trk: trks 8421, then 2 or 3 bits of zeros, then 8421
       result->blktype = BS_TAPEMARK; }
    else if (result->maxbits <= NRZI_MIN_BLOCK) {  // too small, but not tapemark: just noise
       dlog("   detected noise block of length %d at %.8lf\n", result->maxbits, timenow);
@@ -166,6 +215,7 @@ void nrzi_addbit(struct trkstate_t *t, byte bit, double t_bit) { // add a NRZI b
             timenow, TICK(timenow), nrzi.clkavg.t_bitspaceavg*1e6, t->agc_gain);
    uint16_t mask = 1 << (ntrks - 1 - t->trknum);  // update this track's bit in the data array
    data[t->datacount] = bit ? data[t->datacount] | mask : data[t->datacount] & ~mask;
+   mark_weak_bit(t, t->datacount, t->confidence < WEAK_CONFIDENCE); // a zero is suspect if the track's last peak was weak
    data_time[t->datacount] = t_bit;
    if (t->datacount < MAXBLOCK) ++t->datacount;
    if (nrzi.post_counter > 0 && bit) { // we're at the end of a block and get a one: must be LRC or CRC
@@ -245,10 +295,22 @@ void nrzi_zerocheck(void) {  // we're more or less in the vicinity of the next c
    int last_complete_byte = 0; // only for debugging
    for (int trknum = 0; trknum < ntrks; ++trknum) {
       struct trkstate_t *t = &trkstate[trknum];
-      bool lastpeak_in_window = t->t_lastpeak > left_edge && t->t_lastpeak < right_edge;
-      bool prevlastpeak_in_window = t->t_prevlastpeak > left_edge && t->t_prevlastpeak < right_edge;
+      double t_lastpeak = t->t_lastpeak, t_prevlastpeak = t->t_prevlastpeak;
+      bool use_peakshift = learn_peakshift && nrzi.datablock && nrzi.post_counter == 0; // (for both correcting and learning)
+      if (use_peakshift) { // move the peaks to where they would be without the shift caused by the pattern of peaks
+         float shift = peakshift_correction(t, t->ps_cells + 1, nrzi.clkavg.t_bitspaceavg);
+         t_lastpeak -= shift;
+         t_prevlastpeak -= shift; }
+      bool lastpeak_in_window = t_lastpeak > left_edge && t_lastpeak < right_edge;
+      bool prevlastpeak_in_window = t_prevlastpeak > left_edge && t_prevlastpeak < right_edge;
+      if (use_peakshift) { // learn from where the uncorrected peak was
+         if (lastpeak_in_window || prevlastpeak_in_window) {
+            peakshift_record(t, (float)((lastpeak_in_window ? t->t_lastpeak : t->t_prevlastpeak) - (nrzi.t_lastclock + nrzi.clkavg.t_bitspaceavg)),
+                             t->ps_cells + 1, nrzi.clkavg.t_bitspaceavg);
+            t->ps_cells = 0; }
+         else ++t->ps_cells; }
       if (lastpeak_in_window) {
-         avg_pos += t->t_lastpeak; // the last peak was in the subject window
+         avg_pos += t_lastpeak; // the last peak was in the subject window
          ++numbits;
          if (prevlastpeak_in_window) { // If the previous peak was also in the window, we have a noisy peak.
             --t->datacount;  // delete the 1-bit for one of the peaks
@@ -257,11 +319,11 @@ void nrzi_zerocheck(void) {  // we're more or less in the vicinity of the next c
                     trknum, t->t_lastpeak, TICK(t->t_lastpeak)); }
          if (DEBUG) last_complete_byte = t->datacount - 1; }
       else if (prevlastpeak_in_window) {
-         avg_pos += t->t_prevlastpeak; // the peak before that was in the window
+         avg_pos += t_prevlastpeak; // the peak before that was in the window
          ++numbits;
          if (DEBUG) last_complete_byte = t->datacount - 2; }
       else { // neither: we missed a peak on this track and must record a zero bit
-         if (t->t_lastpeak > right_edge) { // but if there was a subsequent peak,
+         if (t_lastpeak > right_edge) { // but if there was a subsequent peak,
             --t->datacount; // temporarily erase that one bit
             nrzi_addbit(t, 0, nrzi.t_lastclock + nrzi.clkavg.t_bitspaceavg); // add the zero bit
             nrzi_addbit(t, 1, t->t_lastpeak); // and then put back the one bit
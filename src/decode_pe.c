@@ -98,8 +98,15 @@ void pe_end_of_block(void) { // All/most tracks have just become idle. See if we
          if (DEBUG) show_track_datacounts("*** trkmismatched block");
          result->track_mismatch = result->maxbits - result->minbits; }
       result->vparity_errs = 0;
+      result->first_error = -1;
+#if CORRECT
+      if (do_correction) correct_parity_erasures(result->minbits, true);
+#endif
       for (int i = 0; i < result->minbits; ++i) // count parity errors
-         if (parity(data[i]) != expected_parity) ++result->vparity_errs; } }
+         if (parity(data[i]) != expected_parity) {
+            if (result->first_error < 0) result->first_error = i;
+            ++result->vparity_errs; }
+      if (result->first_error < 0 && result->track_mismatch) result->first_error = result->minbits; } }
 
 void pe_addbit (struct trkstate_t *t, byte bit, bool faked, double t_bit) { // we encountered a data bit transition
    TRACE(data, t_bit, bit ? UPTICK : DNTICK, t);
@@ -120,6 +127,7 @@ void pe_addbit (struct trkstate_t *t, byte bit, bool faked, double t_bit) { // w
       uint16_t mask = 1 << (ntrks - 1 - t->trknum);  // update this track's bit in the data array
       data[t->datacount] = bit ? data[t->datacount] | mask : data[t->datacount] & ~mask;
       data_faked[t->datacount] = faked ? data_faked[t->datacount] | mask : data_faked[t->datacount] & ~mask;
+      mark_weak_bit(t, t->datacount, !faked && t->confidence < WEAK_CONFIDENCE);
       if (faked) ++block.results[block.parmset].corrected_bits;
       data_time[t->datacount] = t_bit;
       if (t->datacount < MAXBLOCK) ++t->datacount; } }
@@ -128,6 +136,9 @@ void pe_preamble_peak(struct trkstate_t *t, bool is_top) {
    // process a peak during the preamble, and see if it is a one-bit that starts the data
    if (t->peakcount == 1) {  // the first transition, which is a 0-bit, sets the bit polarity
       t->bit1_up = !is_top; // (normally 1 is up, but might be reversed depending on logic analyzer polarity)
+      // Going backwards for -bidir, the first transition may be the clock after the last 0-bit of the postamble,
+      // so we use the polarity we found going forwards.
+      if (bidir_backward) t->bit1_up = bidir_bit1_up[t->trknum];
       static warned_polarity = false; // should be in a file-specific structure
       if (!t->bit1_up && !warned_polarity) {
          rlog("*** NOTE: we detected reverse PE signal polarity, but we can handle it\n");
@@ -158,7 +169,9 @@ void pe_top (struct trkstate_t *t) {  // local maximum: end of a positive flux t
    if (t->datablock) { // inside a data block
       if (PEAK_STATS)
          record_peakstat(t->clkavg.t_bitspaceavg, (float)(t->t_top - t->t_lastpeak), t->trknum);
-      bool missed_transition = (t->t_top + t->t_pulse_adj) - t->t_lastpeak > t->t_clkwindow; // missed a half-bit transition?
+      float shift = learn_peakshift // how much earlier it should be, because of the pattern of peaks
+                    ? peakshift_correction(t, t->t_top - t->t_lastpeak > t->t_clkwindow ? 2 : 1, t->clkavg.t_bitspaceavg / 2) : 0;
+      bool missed_transition = (t->t_top + t->t_pulse_adj - shift) - t->t_lastpeak > t->t_clkwindow; // missed a half-bit transition?
       if (!t->clknext // if we're expecting a data transition
             || missed_transition) { // or we missed a clock transition
          dlogtrk("trk %d add %d top at %.8lf tick %.1lf + adj %.2f uS, %.3fV, lastpeak at %.8lf tick %.1lf, clkwin %.2f uS\n",
@@ -171,7 +184,9 @@ void pe_top (struct trkstate_t *t) {  // local maximum: end of a positive flux t
          dlogtrk("trk %d clk   top at %.8lf tick %.1lf + adj %.2f uS, %.3fV, lastpeak at %.8lf tick %.1lf, clkwin %.2f uS\n",
                  t->trknum, t->t_top, TICK(t->t_top), t->t_pulse_adj*1e6, t->v_top, t->t_lastpeak, TICK(t->t_lastpeak), t->t_clkwindow*1e6);
          t->clknext = false; }
-      t->t_pulse_adj = ((float)(t->t_top - t->t_lastpeak) - t->clkavg.t_bitspaceavg / (missed_transition ? 1 : 2)) * PARM.pulse_adj;
+      if (learn_peakshift) peakshift_record(t, (float)(t->t_top - t->t_lastpeak) + t->t_pulse_adj - t->clkavg.t_bitspaceavg / (missed_transition ? 1 : 2),
+                                               missed_transition ? 2 : 1, t->clkavg.t_bitspaceavg / 2);
+      t->t_pulse_adj = ((float)(t->t_top - t->t_lastpeak) - shift - t->clkavg.t_bitspaceavg / (missed_transition ? 1 : 2)) * PARM.pulse_adj;
       adjust_agc(t); }
    else { // !datablock: we're inside the preamble
       pe_preamble_peak(t, true); //
@@ -181,7 +196,9 @@ void pe_bot (struct trkstate_t *t) { // local minimum: end of a negative flux tr
    if (t->datablock) { // inside a data block or the postamble
       if (PEAK_STATS)
          record_peakstat(t->clkavg.t_bitspaceavg, (float)(t->t_bot - t->t_lastpeak), t->trknum);
-      bool missed_transition = (t->t_bot + t->t_pulse_adj) - t->t_lastpeak > t->t_clkwindow; // missed a half-bit transition?
+      float shift = learn_peakshift // how much earlier it should be, because of the pattern of peaks
+                    ? peakshift_correction(t, t->t_bot - t->t_lastpeak > t->t_clkwindow ? 2 : 1, t->clkavg.t_bitspaceavg / 2) : 0;
+      bool missed_transition = (t->t_bot + t->t_pulse_adj - shift) - t->t_lastpeak > t->t_clkwindow; // missed a half-bit transition?
       if (!t->clknext // if we're expecting a data transition
             || missed_transition) { // or we missed a clock transition
          dlogtrk("trk %d add %d bot at %.8lf tick %.1lf + adj %.2f uS, %.3fV, lastpeak at %.8lf tick %.1lf, clkwin %.2f uS\n",
@@ -194,7 +211,9 @@ void pe_bot (struct trkstate_t *t) { // local minimum: end of a negative flux tr
          dlogtrk("trk %d clk   bot at %.8lf tick %.1lf + adj %.2f uS, %.3fV, lastpeak at %.8lf tick %.1lf, clkwin %.2f uS\n",
                  t->trknum, t->t_bot, TICK(t->t_bot), t->t_pulse_adj*1e6, t->v_bot, t->t_lastpeak, TICK(t->t_lastpeak), t->t_clkwindow*1e6);
          t->clknext = false; }
-      t->t_pulse_adj = ((float)(t->t_bot - t->t_lastpeak) - t->clkavg.t_bitspaceavg / (missed_transition ? 1 : 2)) * PARM.pulse_adj;
+      if (learn_peakshift) peakshift_record(t, (float)(t->t_bot - t->t_lastpeak) + t->t_pulse_adj - t->clkavg.t_bitspaceavg / (missed_transition ? 1 : 2),
+                                               missed_transition ? 2 : 1, t->clkavg.t_bitspaceavg / 2);
+      t->t_pulse_adj = ((float)(t->t_bot - t->t_lastpeak) - shift - t->clkavg.t_bitspaceavg / (missed_transition ? 1 : 2)) * PARM.pulse_adj;
       adjust_agc(t); }
    else { // !datablock: we're inside the preamble
       pe_preamble_peak(t, false); //
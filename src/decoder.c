@@ -100,6 +100,7 @@ struct trkstate_t trkstate[MAXTRKS] = { 0 };// the current state of all tracks
 
 uint16_t data[MAXBLOCK+1] = { 0 };		     // the reconstructed data in bits 8..0 for tracks 0..7, then P as the LSB
 uint16_t data_faked[MAXBLOCK+1] = { 0 };    // flag for "data was faked" in bits 8..0 for tracks 0..7, then P as the LSB
+uint16_t data_weak[MAXBLOCK+1] = { 0 };     // flag for "data came from a low-confidence peak", in the same order
 double data_time[MAXBLOCK+1] = { 0 };	     // the time the last track contributed to this data byte
 
 struct blkstate_t block;  // the status of the current data block as decoded with the various sets of parameters
@@ -332,24 +333,50 @@ void adjust_deskew(float bitspacing) { // slowly adjust the deskew based on the
 #define ESTDEN_COUNTNEEDED 9999     // how many transitions we need to see for a good estimate
 #define ESTDEN_MINPERCENT 5         // the minimum transition delta time must be seen at least this many percent of the total
 #define ESTDEN_CLOSEPERCENT 20      // how close, in percent, to one of the standard densities we need to be
+#define ESTDEN_MINFORMATCOUNT 250   // for -mixed, the fewest transitions we'll decide the format from
+#define ESTDEN_SHAPEPERCENT 25      // for -mixed, the most PE transitions that can be farther apart than the encoding allows
+#define ESTDEN_GAPSECS 2e-3         // for -mixed, a time without transitions on any track that must be an interblock gap
+#define ESTDEN_BURSTPERCENT 90      // for -mixed, a "block" with this many percent of its transitions on one track is an ID burst
 
 struct {
    int deltas[ESTDEN_NUMBINS];   // distance between transitions, in seconds/ESTDEN_BINWIDTH
    int counts[ESTDEN_NUMBINS];   // how often we've seen that distance
    int binsused;
-   int totalcount; } estden;
+   int totalcount;
+   bool oneblock;                // for -mixed, stop at the end of the first block with enough transitions
+   bool blockdone;               // and we did
+   int trkcounts[MAXTRKS];       // how many transitions were on each track
+   double t_lastpeak; } estden;  // the time of the last transition on any track
 
 void estden_init(void) {
    memset(&estden, 0, sizeof(estden)); }
 
+void estden_init_format(void) {
+   estden_init();
+   estden.oneblock = true; }
+
 bool estden_done(void) {
-   return estden.totalcount >= ESTDEN_COUNTNEEDED; }
+   return estden.totalcount >= ESTDEN_COUNTNEEDED || estden.blockdone; }
 
 bool estden_transition(struct trkstate_t *t, double peaktime, float deltasecs) { // count a transition distance
    int delta = (int) (deltasecs / ESTDEN_BINWIDTH);  // round down to multiple of BINWIDTH
    int ndx;
    //dlog("estden_transition %.3f usec at %.8lf\n", deltasecs*1e6, timenow);
    assert(deltasecs > 0, "negative delta %f usec in estden_transition", deltasecs*1e6);
+   if (estden.oneblock) {
+      if (estden.t_lastpeak > 0 && peaktime - estden.t_lastpeak > ESTDEN_GAPSECS && estden.totalcount >= ESTDEN_MINFORMATCOUNT) {
+         int maxtrk = 0; // this transition is from the next block
+         for (int trk = 1; trk < ntrks; ++trk)
+            if (estden.trkcounts[trk] > estden.trkcounts[maxtrk]) maxtrk = trk;
+         if (estden.trkcounts[maxtrk] < estden.totalcount * ESTDEN_BURSTPERCENT / 100) {
+            estden.blockdone = true;
+            return true; }
+         // The PE and GCR identification bursts at the load point are on only one track. Skip them.
+         if (verbose) rlog("  skipping what looks like an identification burst of %s transitions on track %d ending at %.8lf\n",
+                              intcommas(estden.trkcounts[maxtrk]), maxtrk, estden.t_lastpeak);
+         estden_init_format(); }
+      if (peaktime > estden.t_lastpeak) estden.t_lastpeak = peaktime;
+      ++estden.trkcounts[t->trknum]; }
    if (deltasecs > 0 && deltasecs <= ESTDEN_MAXDELTA) {
       //if (deltasecs < 2e-6)dlog("estden_transition %f usec trk %d thispeak %.8lf tick %.1lf, lastpeak %.8lf tick %.1lf, at %.8lf tick %.1lf\n",
       //   deltasecs*1e6, t->trknum, peaktime, TICK(peaktime), t->t_lastpeak, TICK(t->t_lastpeak), timenow, TICK(timenow));
@@ -394,6 +421,56 @@ void estden_setdensity(int nblks) { // figure out the tape density
          density, (float)(mindist + 0.5) * ESTDEN_BINWIDTH * 1e6, intcommas(estden.totalcount)); }
 
 
+enum mode_t estden_format(float *pbpi) { // for -mixed, figure out the encoding and the density, or return UNKNOWN
+   // With the tape speed known, the minimum transition spacing alone distinguishes the standard formats,
+   // because PE has two transitions per bit. As a check on a PE guess, which could also be NRZI going four
+   // times faster than we were told, we look at the spacings relative to that minimum: PE data and its
+   // all-zeros preamble only have spacings of 1 or 2 half-bits, but NRZI tracks often go much longer without
+   // a transition. (GCR only has spacings of 1 to 3 bits, but missed peaks make that a less reliable test.)
+   static struct {
+      enum mode_t mode;
+      float bpi; } formats[] = {
+      { PE, 1600 }, { GCR, 9042 }, { NRZI, 800 }, { NRZI, 556 }, { NRZI, 200 }, { UNKNOWN, 0 } };
+   //estden_show();
+   if (estden.totalcount < ESTDEN_MINFORMATCOUNT) return UNKNOWN;
+   int mindist = INT_MAX;
+   for (int ndx = 0; ndx < estden.binsused; ++ndx) {
+      if (estden.counts[ndx] > estden.totalcount * ESTDEN_MINPERCENT / 100
+            && estden.deltas[ndx] < mindist)
+         mindist = estden.deltas[ndx]; }
+   if (mindist == INT_MAX) return UNKNOWN;
+   // Use the average of the spacings in the cluster at that minimum, since with coarse sampling the cluster can be wide
+   float sum = 0;
+   int count = 0;
+   for (int ndx = 0; ndx < estden.binsused; ++ndx)
+      if (estden.deltas[ndx] + 0.5f < 1.4f * (mindist + 0.5f)) {
+         sum += (estden.deltas[ndx] + 0.5f) * estden.counts[ndx];
+         count += estden.counts[ndx]; }
+   float mindelta = sum / count * (float)ESTDEN_BINWIDTH;
+   float density = 1.0f / (ips * mindelta); // transitions per inch
+   int over = 0; // how many transitions were too far apart for PE
+   for (int ndx = 0; ndx < estden.binsused; ++ndx)
+      if ((estden.deltas[ndx] + 0.5f) * (float)ESTDEN_BINWIDTH > 2.5f * mindelta) over += estden.counts[ndx];
+   for (int ndx = 0; formats[ndx].mode != UNKNOWN; ++ndx) {
+      if (ntrks != 9 && formats[ndx].mode != NRZI) continue; // 7-track tapes are only NRZI
+      float stddensity = formats[ndx].mode == PE ? 2 * formats[ndx].bpi : formats[ndx].bpi;
+      float diff = density - stddensity;
+      if (diff < 0) diff = -diff;
+      if (diff < stddensity * ESTDEN_CLOSEPERCENT / 100) {
+         if (formats[ndx].mode == PE && over > estden.totalcount * ESTDEN_SHAPEPERCENT / 100) {
+            if (verbose) rlog("  the transition density of %.0f/inch suggests PE, but %d%% of the transitions are too far apart for that\n",
+                                 density, over * 100 / estden.totalcount);
+            return UNKNOWN; }
+         *pbpi = formats[ndx].bpi;
+         if (verbose) rlog("  the format looks like %s at %.0f BPI after seeing %s transitions in %d bins that imply %.0f transitions/inch\n",
+                             formats[ndx].mode == PE ? "PE" : formats[ndx].mode == GCR ? "GCR" : "NRZI",
+                             formats[ndx].bpi, intcommas(estden.totalcount), estden.binsused, density);
+         return formats[ndx].mode; } }
+   if (verbose) rlog("  the transition density of %.0f/inch after seeing %s transitions doesn't match any standard format\n",
+                       density, intcommas(estden.totalcount));
+   return UNKNOWN; }
+
+
 /*****************************************************************************************************************************
    Routines used for all encoding types
 ******************************************************************************************************************************/
@@ -405,11 +482,402 @@ void init_blockstate(void) {	// initialize block state information for multiple
       block.results[parmndx].blktype = BS_NONE; } }
 
 void init_clkavg(struct clkavg_t *c, float init_avg) { // initialize a clock averaging structure
-   c->t_bitspaceavg = init_avg;
+   c->t_bitspaceavg = c->t_pll_period = init_avg;
+   c->t_pll_phase = 0;
    c->bitndx = 0;
    for (int i = 0; i < CLKRATE_WINDOW; ++i) // initialize moving average bitspacing array
       c->t_bitspacing[i] = init_avg; }
 
+/***********************************************************************************************************************
+   Routines for the tape-wide speed model used by -drift.
+   Each block normally starts its clock at the nominal bit spacing and converges during the preamble, but a
+   sagging capstan or stretched tape makes the real speed wander slowly over the whole tape. We fit a line to
+   the average bit spacing of recent good blocks against tape time, with older blocks weighted less, and
+   use its prediction to start the clock and size the peak-detect window of each new block.
+************************************************************************************************************************/
+
+#define SPEED_MODEL_DECAY  0.9      // weight of each older block relative to the next one
+#define SPEED_MODEL_MINBLKS 8       // how many good blocks we need before we fit a line instead of using their average
+#define SPEED_MODEL_MAXTREND 0.02   // the trend line can move the prediction at most this fraction from the average
+
+static struct { // exponentially-weighted sums for a least squares fit of bit spacing (y) against tape time (t)
+   double t0;                    // the time of the first block, to keep the sums well-conditioned
+   double w, t, y, tt, ty;       // sums of weights, and of weighted t, y, t^2, t*y
+   int nblks;                    // how many blocks contributed
+   float min_predicted, max_predicted; } speed_model;
+
+void speed_model_init(void) {
+   memset(&speed_model, 0, sizeof(speed_model)); }
+
+void speed_model_update(float bitspacing, double time) { // a good block had this average bit spacing
+   float nominal = 1 / (bpi*ips);
+   if (bpi == 0 || bitspacing <= 0 || fabsf(bitspacing - nominal) > nominal * PLL_MAX_DEVIATION) return; // implausible
+   if (speed_model.nblks++ == 0) speed_model.t0 = time;
+   double t = time - speed_model.t0;
+   speed_model.w = SPEED_MODEL_DECAY * speed_model.w + 1;
+   speed_model.t = SPEED_MODEL_DECAY * speed_model.t + t;
+   speed_model.y = SPEED_MODEL_DECAY * speed_model.y + bitspacing;
+   speed_model.tt = SPEED_MODEL_DECAY * speed_model.tt + t * t;
+   speed_model.ty = SPEED_MODEL_DECAY * speed_model.ty + t * bitspacing; }
+
+float speed_model_bitspacing(void) { // the predicted bit spacing for a block starting now
+   float nominal = 1 / (bpi*ips);
+   if (speed_model.nblks == 0) return nominal;
+   double predicted = speed_model.y / speed_model.w; // the weighted average
+   double denom = speed_model.w * speed_model.tt - speed_model.t * speed_model.t;
+   if (speed_model.nblks >= SPEED_MODEL_MINBLKS && denom > 0) { // extrapolate the weighted trend line
+      double slope = (speed_model.w * speed_model.ty - speed_model.t * speed_model.y) / denom;
+      double dt = timenow - speed_model.t0 - speed_model.t / speed_model.w; // how far we are from the weighted center
+      double maxdt = sqrt(denom) / speed_model.w; // don't extrapolate much beyond the spread of the data
+      double maxtrend = predicted * SPEED_MODEL_MAXTREND; // or wildly in any case
+      predicted += min(max(slope * min(max(dt, -maxdt), maxdt), -maxtrend), maxtrend); }
+   predicted = min(max(predicted, nominal * (1 - PLL_MAX_DEVIATION)), nominal * (1 + PLL_MAX_DEVIATION));
+   if (speed_model.min_predicted == 0 || predicted < speed_model.min_predicted) speed_model.min_predicted = (float)predicted;
+   if (predicted > speed_model.max_predicted) speed_model.max_predicted = (float)predicted;
+   return (float)predicted; }
+
+void speed_model_report(void) {
+   if (speed_model.nblks == 0) rlog("  the speed model had no good blocks to learn from\n");
+   else rlog("  the speed model learned from %d good blocks, and predicted speeds from %.2f to %.2f IPS\n",
+                speed_model.nblks, 1 / (speed_model.max_predicted * bpi), 1 / (speed_model.min_predicted * bpi)); }
+
+float initial_bitspacing(void) { // the bit spacing to start a block's clock with
+   return speed_drift && bpi > 0 ? speed_model_bitspacing() : 1 / (bpi*ips); }
+
+/***********************************************************************************************************************
+   Routines for the baseline restoration used by -baseline.
+   Some captures ride on a DC offset that drifts slowly, from the coupling of the head or the amplifier. That makes
+   the tops and bottoms lopsided for the min_peak test, and moves the zero crossings. We keep an estimate of the
+   offset for each track and subtract it from every sample. After each transition we look at the most recent top and
+   bottom, which for zero crossings are the biggest excursions between them. The offset that's left is their
+   midpoint, and we move the estimate a little towards removing it. The estimate at the start of a block is
+   restored for each decoding of it, so that all the parmsets see the same thing. Differentiation already removes
+   any DC offset, so none of this is done with -differentiate.
+************************************************************************************************************************/
+
+#define BASELINE_ALPHA  0.05f    // how much of the remaining offset we remove after each transition
+
+static struct baseline_t { // the baseline state for one track
+   float offset;           // the offset we are subtracting
+   float offset_blockstart; // what it was when the current block started
+   float top, bot;         // the most recent top and bottom after removing the offset, or 0 if none yet
+   float hi, lo;           // the biggest excursions since the last transition, when looking for zero crossings
+   float max_offset; }     // the biggest offset we subtracted
+baseline[MAXTRKS];
+
+void baseline_init(void) { // start a new file with no offset
+   memset(baseline, 0, sizeof(baseline)); }
+
+void baseline_start_block(void) { // get ready for a new decoding of a block
+   for (int trk = 0; trk < ntrks; ++trk) {
+      struct baseline_t *b = &baseline[trk];
+      b->offset = b->offset_blockstart;
+      b->top = b->bot = b->hi = b->lo = 0; } }
+
+void baseline_block_done(void) { // the block we just wrote was decoded with the offsets we have now
+   for (int trk = 0; trk < ntrks; ++trk) baseline[trk].offset_blockstart = baseline[trk].offset; }
+
+void baseline_restore(struct sample_t *psample) { // remove the offset from each track of a sample
+   for (int trk = 0; trk < ntrks; ++trk) {
+      struct baseline_t *b = &baseline[trk];
+      float v = psample->voltage[trk] -= b->offset;
+      if (v > b->hi) b->hi = v;
+      if (v < b->lo) b->lo = v; } }
+
+void baseline_transition(struct trkstate_t *t, bool up) { // the decoder found a peak or zero crossing
+   if (bidir_backward) return;
+   struct baseline_t *b = &baseline[t->trknum];
+   if (find_zeros) { // a crossing up ends an excursion below zero, and starts one above
+      if (up) {
+         b->bot = b->lo;
+         b->hi = 0; }
+      else {
+         b->top = b->hi;
+         b->lo = 0; } }
+   else if (up) b->top = t->v_top;
+   else b->bot = t->v_bot;
+   if (b->top > 0 && b->bot < 0) {
+      b->offset += BASELINE_ALPHA * (b->top + b->bot) / 2;
+      if (fabsf(b->offset) > fabsf(b->max_offset)) b->max_offset = b->offset; } }
+
+void baseline_report(void) {
+   int worst = 0;
+   for (int trk = 1; trk < ntrks; ++trk)
+      if (fabsf(baseline[trk].max_offset) > fabsf(baseline[worst].max_offset)) worst = trk;
+   rlog("  the largest baseline offset removed was %.3fV on track %d", baseline[worst].max_offset, worst);
+   if (verbose) {
+      rlog(", and the offsets at the end were:\n   ");
+      for (int trk = 0; trk < ntrks; ++trk) rlog(" %.3fV", baseline[trk].offset); }
+   rlog("\n"); }
+
+/***********************************************************************************************************************
+   Routines for the adaptive equalizer used by -equalize.
+   At high densities the read pulses from adjacent flux transitions overlap, which shrinks the peaks and pushes
+   them apart. Each track's samples go through a short FIR filter with taps half a minimum peak spacing apart.
+   It starts out passing the signal unchanged, and is trained by normalized LMS so that its output looks like
+   the ideal signal for the transitions the decoder actually found: a narrow pulse at each peak, or a steep
+   ramp through each zero crossing if we're looking for those. The taps are kept symmetric so the filter
+   doesn't move the peaks, and they leak back towards passing the signal unchanged so that noise can't
+   train them into something extreme. A sample is trained on once a later transition has been found, and the
+   training during a block is adopted only if that block decodes without errors.
+************************************************************************************************************************/
+
+#define EQ_TAPS          3          // number of filter taps, which must be odd
+#define EQ_TAPS_PER_PEAK 2          // how many taps per minimum peak spacing
+#define EQ_HISTORY       1024       // how many recent input samples we remember for each track
+#define EQ_PEAKS         16         // how many recent transitions we remember for each track
+#define EQ_MU            0.01f      // the normalized LMS step size
+#define EQ_LEAK          0.0003f    // how fast the taps leak back towards passing the signal unchanged
+#define EQ_PEAK_WIDTH    1.0f       // the half-width of the ideal pulse at a peak, in minimum peak spacings
+#define EQ_ZERO_WIDTH    0.25f      // the half-width of the ideal ramp at a zero crossing, in minimum peak spacings
+#define EQ_BASELINE_ALPHA 0.001f    // the weight of each sample in the average input voltage
+
+static struct eq_t { // the equalizer for one track
+   float taps[EQ_TAPS];          // the filter we use
+   float training[EQ_TAPS];      // the filter we're training during this block
+   float x[EQ_HISTORY];          // recent input samples, circularly indexed by the sample number
+   double t[EQ_HISTORY];         // and their times
+   int64_t nsamples, ntrained;   // how many samples we've seen in this block, and how many we've trained on
+   double t_peak[EQ_PEAKS];      // recent transitions we found, circularly indexed by the transition number
+   bool up[EQ_PEAKS];            // and whether each was a top (or a zero crossing up)
+   int npeaks;                   // how many transitions we've seen in this block
+   float avg_height;             // the running average height of the input peaks
+   float baseline; }             // the running average input voltage
+eq[MAXTRKS];
+static int eq_spacing = 0;       // the number of samples between taps, or 0 if we aren't equalizing this block
+static float eq_width;           // the half-width of the ideal pulse or ramp, in seconds
+static int eq_blocks_learned = 0;
+
+void equalizer_init(void) { // start a new file with filters that pass the signal unchanged
+   memset(eq, 0, sizeof(eq));
+   for (int trk = 0; trk < MAXTRKS; ++trk) eq[trk].taps[EQ_TAPS / 2] = 1;
+   eq_blocks_learned = 0; }
+
+void equalizer_start_block(void) { // get ready for a new decoding of a block
+   eq_spacing = 0;
+   if (mode == WW || bpi == 0
+         || (find_zeros && do_differentiate)) return; // (that zero crossing detector needs the small deltas to stay zero)
+   float peak_spacing = mode == PE ? 1 / (2 * bpi*ips) : 1 / (bpi*ips);
+   eq_spacing = max(1, (int)(peak_spacing / sample_deltat / EQ_TAPS_PER_PEAK + 0.5f));
+   assert(eq_spacing * (EQ_TAPS - 1) < EQ_HISTORY / 2, "too many samples per bit for the equalizer; use -subsample");
+   eq_width = (find_zeros ? EQ_ZERO_WIDTH : EQ_PEAK_WIDTH) * peak_spacing;
+   for (int trk = 0; trk < ntrks; ++trk) {
+      struct eq_t *e = &eq[trk];
+      memcpy(e->training, e->taps, sizeof(e->taps));
+      memset(e->x, 0, sizeof(e->x)); // the samples before the block are zero
+      e->nsamples = e->ntrained = 0;
+      e->npeaks = 0; } }
+
+static void eq_train(struct eq_t *e, int64_t n, double t_skew) { // train on input sample n
+   int ndx = (int)(n % EQ_HISTORY);
+   double t = e->t[ndx] + t_skew; // when the decoder saw the output for this sample
+   float target = 0;
+   if (find_zeros) { // the ideal signal ramps through the nearest zero crossing
+      int nearest = -1;
+      for (int p = max(0, e->npeaks - EQ_PEAKS); p < e->npeaks; ++p)
+         if (nearest < 0 || fabs(t - e->t_peak[p % EQ_PEAKS]) < fabs(t - e->t_peak[nearest % EQ_PEAKS])) nearest = p;
+      if (nearest < 0) return;
+      double dt = t - e->t_peak[nearest % EQ_PEAKS];
+      if (fabs(dt) >= eq_width) return; // we don't know the ideal level between the crossings
+      target = (e->up[nearest % EQ_PEAKS] ? e->avg_height : -e->avg_height) * (float)(dt / eq_width); }
+   else for (int p = max(0, e->npeaks - EQ_PEAKS); p < e->npeaks; ++p) { // add up the ideal pulses of nearby peaks
+         double dt = fabs(t - e->t_peak[p % EQ_PEAKS]);
+         if (dt < eq_width) target += (e->up[p % EQ_PEAKS] ? e->avg_height : -e->avg_height) * (float)(1 - dt / eq_width); }
+   float xk[EQ_TAPS], y = 0;
+   for (int k = 0; k < EQ_TAPS; ++k) {
+      xk[k] = e->x[(ndx - k * eq_spacing + EQ_HISTORY) % EQ_HISTORY] - e->baseline; // (don't learn to shrink any offset)
+      y += e->training[k] * xk[k]; }
+   // Normalize by the power of a window full of peaks, not the actual power, so that the long quiet stretches
+   // between NRZI transitions only make small adjustments to what the peaks have taught us.
+   float step = EQ_MU * (target - y) / (EQ_TAPS * e->avg_height * e->avg_height + 1e-6f);
+   for (int k = 0; k <= EQ_TAPS / 2; ++k) { // update each symmetric pair of taps together
+      float tap = e->training[k] + step * (xk[k] + xk[EQ_TAPS - 1 - k]) / 2;
+      tap -= EQ_LEAK * (tap - (k == EQ_TAPS / 2));
+      e->training[k] = e->training[EQ_TAPS - 1 - k] = tap; } }
+
+static void eq_train_until(struct eq_t *e, double t_limit, double t_skew) { // train on the samples before t_limit
+   int64_t oldest = e->nsamples - EQ_HISTORY + EQ_TAPS * eq_spacing; // the oldest sample with a whole window
+   if (e->ntrained < oldest) e->ntrained = oldest;
+   while (e->ntrained < e->nsamples && e->t[e->ntrained % EQ_HISTORY] + t_skew < t_limit)
+      eq_train(e, e->ntrained++, t_skew); }
+
+void equalizer_transition(struct trkstate_t *t, double t_peak, bool up) { // the decoder found a peak or zero crossing
+   if (doing_density_detection || bidir_backward || eq_spacing == 0) return;
+   struct eq_t *e = &eq[t->trknum];
+   double t_skew = skew_delaycnt[t->trknum] * sample_deltat; // (deskewing delays what the decoder sees)
+   // The ideal height is the average height of the input peaks, so that the filter can't drift towards zero gain.
+   // Look for it in the input near the peak, or since the previous zero crossing, delayed by the center tap.
+   int newest = (int)((e->t[(e->nsamples - 1) % EQ_HISTORY] + t_skew - t_peak) / sample_deltat + 0.5f) + EQ_TAPS / 2 * eq_spacing;
+   int oldest = newest + eq_spacing;
+   if (!find_zeros) newest -= eq_spacing;
+   else if (e->npeaks > 0) oldest = newest + (int)((t_peak - e->t_peak[(e->npeaks - 1) % EQ_PEAKS]) / sample_deltat);
+   float height = 0;
+   for (int d = max(0, newest); d <= oldest && d < e->nsamples && d < EQ_HISTORY; ++d)
+      height = max(height, fabsf(e->x[(e->nsamples - 1 - d) % EQ_HISTORY] - e->baseline));
+   if (height > 0) e->avg_height = e->avg_height == 0 ? height : 0.9f * e->avg_height + 0.1f * height;
+   e->t_peak[e->npeaks % EQ_PEAKS] = t_peak;
+   e->up[e->npeaks % EQ_PEAKS] = up;
+   ++e->npeaks;
+   eq_train_until(e, t_peak - eq_width, t_skew); }
+
+void equalizer_block_done(bool clean) { // adopt the training from the block we just wrote if it had no errors
+   if (!clean || eq_spacing == 0) return;
+   for (int trk = 0; trk < ntrks; ++trk) { // all the transitions are known now, so train on the end of the block too
+      eq_train_until(&eq[trk], DBL_MAX, skew_delaycnt[trk] * sample_deltat);
+      memcpy(eq[trk].taps, eq[trk].training, sizeof(eq[trk].taps)); }
+   ++eq_blocks_learned; }
+
+void equalize(struct sample_t *psample, int trk) { // filter one sample of one track
+   if (eq_spacing == 0 || doing_density_detection || bidir_backward) return;
+   struct eq_t *e = &eq[trk];
+   int ndx = (int)(e->nsamples % EQ_HISTORY);
+   e->x[ndx] = psample->voltage[trk];
+   e->t[ndx] = psample->time;
+   e->baseline += EQ_BASELINE_ALPHA * (psample->voltage[trk] - e->baseline);
+   float y = 0;
+   for (int k = 0; k < EQ_TAPS; ++k)
+      y += e->taps[k] * e->x[(ndx - k * eq_spacing + EQ_HISTORY) % EQ_HISTORY];
+   ++e->nsamples;
+   psample->voltage[trk] = y; }
+
+void equalizer_report(void) {
+   rlog("  the equalizer learned from %d block%s without errors", eq_blocks_learned, eq_blocks_learned != 1 ? "s" : "");
+   if (verbose && eq_blocks_learned > 0) {
+      rlog(", ending with these taps %d samples apart:\n", eq_spacing);
+      for (int trk = 0; trk < ntrks; ++trk) {
+         rlog("    trk %d:", trk);
+         for (int k = 0; k < EQ_TAPS; ++k) rlog(" %6.3f", eq[trk].taps[k]);
+         rlog("\n"); } }
+   else rlog("\n"); }
+
+/***********************************************************************************************************************
+   Routines for the learned peak-shift compensation used by -peakshift.
+   The read pulses from nearby flux transitions overlap and push each other's peaks apart, so the time between two
+   peaks depends on the bit pattern around them, not just on how many bit cells they are apart. We learn, for each
+   track, the average deviation of that time from the nominal, indexed by the number of cells between the previous
+   two transitions and the number between the previous one and this one. Since the previous peak's shift depends on
+   its neighbors on both sides, that covers the pattern before and after it. For NRZI the deviation is of the peak
+   from the common clock instead. The table is learned from the first blocks that decode without errors, and is then
+   used to correct the timing of each peak before deciding which bit cell it is in. The parmset thresholds for
+   those decisions already allow for the average shift, so we correct only for how each pattern differs from that,
+   and only for half of it, since the peaks that follow also move the clock and the pulse adjustment.
+************************************************************************************************************************/
+
+#define PS_CELLS        4       // the most bit cells between transitions that we distinguish
+#define PS_LEARN_BLOCKS 8       // how many blocks without errors we learn from
+#define PS_MIN_COUNT    100     // how often we must have seen a pattern to correct for it
+#define PS_WEIGHT       0.5f    // how much of the average shift we correct for
+#define PS_MAX_SHIFT    0.10f   // the largest correction we make, as a fraction of a bit cell
+
+static struct peakshift_t {   // the peak-shift state for one track
+   double block_sum[PS_CELLS + 1][PS_CELLS + 1]; // the deviations in this decoding of the block, in bit cells
+   int block_count[PS_CELLS + 1][PS_CELLS + 1];
+   double sum[PS_CELLS + 1][PS_CELLS + 1];       // the deviations in all the blocks we have learned from
+   int count[PS_CELLS + 1][PS_CELLS + 1];
+   float shift[PS_CELLS + 1][PS_CELLS + 1]; }    // the learned correction, in bit cells
+peakshift[MAXTRKS];
+static int ps_blocks_learned;
+static bool ps_learned;       // is the table ready to use?
+
+void peakshift_init(void) { // start a new file with nothing learned
+   memset(peakshift, 0, sizeof(peakshift));
+   ps_blocks_learned = 0;
+   ps_learned = false; }
+
+void peakshift_start_block(void) { // get ready for a new decoding of a block
+   for (int trk = 0; trk < ntrks; ++trk) {
+      memset(peakshift[trk].block_sum, 0, sizeof(peakshift[trk].block_sum));
+      memset(peakshift[trk].block_count, 0, sizeof(peakshift[trk].block_count)); } }
+
+float peakshift_correction(struct trkstate_t *t, int cells, float cellwidth) {
+   // how much earlier than measured a peak should be considered, if it is tentatively this many cells after the last one
+   if (!ps_learned || t->ps_prevcells == 0 || bidir_backward || doing_density_detection) return 0;
+   cells = max(1, min(cells, PS_CELLS));
+   return peakshift[t->trknum].shift[t->ps_prevcells][cells] * cellwidth; }
+
+void peakshift_record(struct trkstate_t *t, float deviation, int cells, float cellwidth) {
+   // record how much a peak that we decided was this many cells after the last one deviated from the nominal
+   if (bidir_backward || doing_density_detection) return;
+   cells = max(1, min(cells, PS_CELLS));
+   if (!ps_learned && t->ps_prevcells > 0) {
+      peakshift[t->trknum].block_sum[t->ps_prevcells][cells] += deviation / cellwidth;
+      ++peakshift[t->trknum].block_count[t->ps_prevcells][cells]; }
+   t->ps_prevcells = cells; }
+
+void peakshift_block_done(bool clean) { // learn from the block we just wrote if it had no errors
+   if (ps_learned || !clean) return;
+   for (int trk = 0; trk < ntrks; ++trk) {
+      struct peakshift_t *p = &peakshift[trk];
+      for (int prev = 1; prev <= PS_CELLS; ++prev)
+         for (int cells = 1; cells <= PS_CELLS; ++cells) {
+            p->sum[prev][cells] += p->block_sum[prev][cells];
+            p->count[prev][cells] += p->block_count[prev][cells]; } }
+   if (++ps_blocks_learned < PS_LEARN_BLOCKS) return;
+   for (int trk = 0; trk < ntrks; ++trk) { // we have seen enough: compute the table and start using it
+      struct peakshift_t *p = &peakshift[trk];
+      for (int cells = 1; cells <= PS_CELLS; ++cells) {
+         double sum = 0;  // the average deviation for this many cells, whatever came before,
+         int count = 0;   // which the thresholds in the parmsets already allow for
+         for (int prev = 1; prev <= PS_CELLS; ++prev) {
+            sum += p->sum[prev][cells];
+            count += p->count[prev][cells]; }
+         for (int prev = 1; prev <= PS_CELLS; ++prev)
+            if (p->count[prev][cells] >= PS_MIN_COUNT) {
+               float shift = PS_WEIGHT * (float)(p->sum[prev][cells] / p->count[prev][cells] - sum / count);
+               p->shift[prev][cells] = max(-PS_MAX_SHIFT, min(shift, PS_MAX_SHIFT)); } } }
+   ps_learned = true; }
+
+void peakshift_report(void) {
+   if (!ps_learned) {
+      rlog("  the peak-shift table wasn't used, because only %d block%s decoded without errors\n",
+           ps_blocks_learned, ps_blocks_learned != 1 ? "s" : "");
+      return; }
+   rlog("  the peak-shift table was learned from the first %d blocks without errors", PS_LEARN_BLOCKS);
+   if (verbose) {
+      rlog(", and its corrections in %% of a bit cell are:\n");
+      rlog("    cells before,after the previous peak:");
+      for (int prev = 1; prev <= PS_CELLS; ++prev)
+         for (int cells = 1; cells <= PS_CELLS; ++cells) rlog("  %d,%d", prev, cells);
+      rlog("\n");
+      for (int trk = 0; trk < ntrks; ++trk) {
+         rlog("    trk %d:%31s", trk, "");
+         for (int prev = 1; prev <= PS_CELLS; ++prev)
+            for (int cells = 1; cells <= PS_CELLS; ++cells) rlog(" %4d", (int)roundf(peakshift[trk].shift[prev][cells] * 100));
+         rlog("\n"); } }
+   else rlog("\n"); }
+
+/***********************************************************************************************************************
+   The models that learn across blocks, for -drift, -health, -equalize, -baseline and -peakshift.
+   None of them are used for Whirlwind, and -baseline isn't used with -differentiate; those flags are
+   turned off once we know the mode, so the flag alone says whether a model is in use.
+************************************************************************************************************************/
+
+void models_init(void) { // start over on what we learned, for a new file or format
+   speed_model_init();
+   track_health_init();
+   equalizer_init();
+   baseline_init();
+   peakshift_init(); }
+
+void models_start_block(void) { // starting a decoding of a block
+   if (restore_baseline) baseline_start_block();
+   if (equalizing && !doing_density_detection) equalizer_start_block();
+   if (learn_peakshift) peakshift_start_block(); }
+
+void models_block_done(int length, bool clean) { // the block we just wrote had "length" bytes and no errors if "clean"
+   if (speed_drift && clean) speed_model_update(block.results[block.parmset].avg_bit_spacing, timenow);
+   if (track_health && length > 0) track_health_update(length);
+   if (equalizing) equalizer_block_done(clean);
+   if (restore_baseline) baseline_block_done();
+   if (learn_peakshift) peakshift_block_done(clean); }
+
+void models_report(void) {
+   if (speed_drift) speed_model_report();
+   if (track_health) track_health_report();
+   if (equalizing) equalizer_report();
+   if (restore_baseline) baseline_report();
+   if (learn_peakshift) peakshift_report(); }
+
 void init_trackpeak_state(void) { // this is also used by Whirlwind when we move back in the file
 #if DESKEW
    memset(&skew, 0, sizeof(skew));
@@ -429,12 +897,14 @@ void init_trackstate(void) {  // initialize all track and some block state infor
    block.endblock_done = false;
    expected_parity = specified_parity;
    if (mode == GCR) gcr_preprocess();
+   models_start_block();
    init_trackpeak_state();
    memset(&block.results[block.parmset], 0, sizeof(struct results_t));
    block.results[block.parmset].blktype = BS_NONE;
    block.results[block.parmset].alltrk_max_agc_gain = 0.0;
    block.results[block.parmset].alltrk_min_agc_gain = FLT_MAX;
    memset(trkstate, 0, sizeof(trkstate));  // only need to initialize non-zeros below
+   float bitspacing = initial_bitspacing();
    for (int trknum = 0; trknum < ntrks; ++trknum) {
       struct trkstate_t *trk = &trkstate[trknum];
       trk->trknum = trknum;
@@ -442,17 +912,18 @@ void init_trackstate(void) {  // initialize all track and some block state infor
       trk->v_last_raw = 0;
       //  trk->zerocross_dn_pending = trk->zerocross_up_pending = true; // allow first zerocrossing to occur from an idle track
       trk->agc_gain = 1.0;
+      trk->confidence = 1.0;
       trk->max_agc_gain = 0.0;
       trk->min_agc_gain = FLT_MAX;
       trk->v_avg_height = PKWW_PEAKHEIGHT;
-      if (!doing_density_detection) init_clkavg(&trk->clkavg, 1 / (bpi*ips));
+      if (!doing_density_detection) init_clkavg(&trk->clkavg, bitspacing);
       trk->t_clkwindow = trk->clkavg.t_bitspaceavg / 2 * PARM.clk_factor; }
    if (mode == NRZI) {
       memset(&nrzi, 0, sizeof(nrzi));
-      if (!doing_density_detection) init_clkavg(&nrzi.clkavg, 1 / (bpi*ips)); }
+      if (!doing_density_detection) init_clkavg(&nrzi.clkavg, bitspacing); }
    if (mode == WW) {
       memset(&ww, 0, sizeof(ww));
-      if (!doing_density_detection) init_clkavg(&ww.clkavg, 1 / (bpi*ips)); } }
+      if (!doing_density_detection) init_clkavg(&ww.clkavg, bitspacing); } }
 
 void set_expected_parity(int blklength) {
    expected_parity =
@@ -534,7 +1005,27 @@ void adjust_clock(struct clkavg_t *c, float delta, int trk) {  // update the bit
    int clk_window = PARM.clk_window;
    float clk_alpha = PARM.clk_alpha;
    float prevdelta = c->t_bitspaceavg;
-   if (clk_window > 0) { // *** STRATEGY 1: do moving-window averaging
+   if (PARM.pll_bw > 0) { // *** STRATEGY 0: second-order phase-locked loop
+      // The loop's oscillator predicts each transition one period after the previous prediction, and the phase error
+      // is how late the actual transition is. Each correction moves the prediction by a proportional amount of the error,
+      // and the period by an integral amount. The gains come from the normalized loop bandwidth and damping factor.
+      // Since the decoders measure from the last actual transition, what we give them is the loop's period.
+      float theta = PARM.pll_bw / (PLL_DAMPING + 1 / (4 * PLL_DAMPING));
+      float denom = 1 + 2 * PLL_DAMPING * theta + theta * theta;
+      float kp = 4 * PLL_DAMPING * theta / denom;
+      float ki = 4 * theta * theta / denom;
+      if (c->t_pll_period == 0) c->t_pll_period = delta; // not initialized, as during density detection
+      float phase_err = c->t_pll_phase + delta - c->t_pll_period;
+      float maxerr = c->t_pll_period / 2; // more than half a bit means a missing or extra transition, not a phase error
+      phase_err = min(max(phase_err, -maxerr), maxerr);
+      c->t_pll_period += ki * phase_err;
+      if (bpi > 0) { // don't let the loop wander off to a ridiculous speed
+         float nominal = 1 / (bpi*ips);
+         c->t_pll_period = min(max(c->t_pll_period, nominal * (1 - PLL_MAX_DEVIATION)), nominal * (1 + PLL_MAX_DEVIATION)); }
+      c->t_pll_phase = phase_err * (1 - kp);
+      c->t_bitspaceavg = c->t_pll_period;
+   }
+   else if (clk_window > 0) { // *** STRATEGY 1: do moving-window averaging
       float olddelta = c->t_bitspacing[c->bitndx]; // save value going out of average
       c->t_bitspacing[c->bitndx] = delta; // insert new value
       if (++c->bitndx >= clk_window) c->bitndx = 0; // circularly increment the index
@@ -555,7 +1046,8 @@ void adjust_clock(struct clkavg_t *c, float delta, int trk) {  // update the bit
    }
 void force_clock(struct clkavg_t *c, float delta, int trk) { // force the clock speed
    for (int i = 0; i < CLKRATE_WINDOW; ++i) c->t_bitspacing[i] = delta;
-   c->t_bitspaceavg = delta; }
+   c->t_bitspaceavg = c->t_pll_period = delta;
+   c->t_pll_phase = 0; }
 
 void process_transition(struct trkstate_t *t) {  // process a transition: a zero-crossing, or peak
    ++t->peakcount;
@@ -571,10 +1063,150 @@ void process_transition(struct trkstate_t *t) {  // process a transition: a zero
          //  attempt to keep this track in sync with the others. .
          pe_generate_fake_bits(t); } }
 
+//****** soft-decision information about peaks, for erasure correction
+
+float peak_confidence(struct trkstate_t *t, float v_peak, float t_delta, float t_unit) {
+   // Estimate how much we believe a peak, from 0 (not at all) to 1 (completely). We use the smallest of
+   //  - its height relative to half of the average peak-to-peak height for this track
+   //  - how close its distance from the previous peak is to a multiple of the expected spacing, t_unit
+   //  - the inverse of the AGC gain, which is high when recent peaks have been small
+   float confidence = 1;
+   if (t->v_avg_height > 0)
+      confidence = min(confidence, 2 * fabsf(v_peak) / t->v_avg_height);
+   if (t_unit > 0 && t_delta > 0) {
+      float units = t_delta / t_unit;
+      float offset = fabsf(units - max(1, roundf(units))); // peaks closer than one unit are suspicious too
+      confidence = min(confidence, 1 - 2 * min(offset, 0.5f)); }
+   if (t->agc_gain > 0)
+      confidence = min(confidence, 1 / t->agc_gain);
+   return confidence; }
+
+static float peak_spacing(struct trkstate_t *t) { // the expected minimum time between peaks on a track
+   if (mode == PE) return t->clkavg.t_bitspaceavg / 2;
+   if (mode == GCR) return t->clkavg.t_bitspaceavg;
+   if (mode == NRZI) return nrzi.clkavg.t_bitspaceavg;
+   return 0; } // Whirlwind: don't judge the timing
+
+void mark_weak_bit(struct trkstate_t *t, int ndx, bool weak) { // record whether a data bit is an erasure candidate
+   uint16_t mask = 1 << (ntrks - 1 - t->trknum);
+   data_weak[ndx] = weak ? data_weak[ndx] | mask : data_weak[ndx] & ~mask; }
+
+/***********************************************************************************************************************
+   Routines for the tape-wide track health model used by -health.
+   A dropout or a weak head usually affects many consecutive blocks on the same track, but each block's decoding
+   starts out knowing nothing about that. After each block is written we score each track: badly in proportion to
+   how many of its bits were corrected or faked, or were erasure candidates in bytes with parity errors, and less badly
+   if its AGC gain went much higher or its peaks were much lower than the other tracks'. The scores are averaged
+   over recent blocks, and a track that is clearly worse than all the others is nominated as the erasure pointer
+   for the correction of the next blocks.
+************************************************************************************************************************/
+
+#define HEALTH_DECAY        0.7f    // weight of a track's previous score
+#define HEALTH_AGC_RATIO    1.5f    // a track whose max AGC gain is this many times the median is suspect
+#define HEALTH_HEIGHT_RATIO 0.6f    // so is a track whose average peak height is less than this fraction of the median
+#define HEALTH_NOMINATE     0.3f    // the minimum score for a track to be nominated
+#define HEALTH_MARGIN       2.0f    // and how many times worse it must be than the next worst track
+
+static struct { // the running health of each track
+   float score;                  // 0 is healthy, 1 is bad in every recent block
+   int nominated_blks; }         // how many blocks it was nominated for
+trkhealth[MAXTRKS];
+uint16_t health_suspect = 0;     // the nominated track as a data[] bit mask, or 0 if none
+
+static float median(float *v, int n) { // the median of n values, which are reordered
+   for (int i = 1; i < n; ++i) // insertion sort, since n is small
+      for (int j = i; j > 0 && v[j - 1] > v[j]; --j) {
+         float temp = v[j]; v[j] = v[j - 1]; v[j - 1] = temp; }
+   return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2; }
+
+void track_health_init(void) {
+   memset(trkhealth, 0, sizeof(trkhealth));
+   health_suspect = 0; }
+
+void track_health_update(int length) { // update the track health from the block we just wrote
+   struct results_t *result = &block.results[block.parmset];
+   int hits[MAXTRKS] = { 0 }, maxhits = 0; // how many bits we blame on each track
+   if (mode == PE || mode == NRZI)
+      for (int i = 0; i < length; ++i) {
+         uint16_t bad = mode == PE ? data_faked[i] : 0; // (NRZI doesn't clear them for each block)
+         if (parity(data[i]) != expected_parity) bad |= data_weak[i];
+         for (int trk = ntrks - 1; bad; --trk, bad >>= 1)
+            if (bad & 1) ++hits[trk]; }
+   for (int trk = 0; trk < ntrks; ++trk) {
+      if (hits[trk] == 0 && result->faked_tracks & (1 << (ntrks - 1 - trk))) hits[trk] = 1; // tracks that had bits corrected
+      maxhits = max(maxhits, hits[trk]); }
+   float gains[MAXTRKS], heights[MAXTRKS];
+   for (int trk = 0; trk < ntrks; ++trk) {
+      gains[trk] = trkstate[trk].max_agc_gain;
+      heights[trk] = trkstate[trk].v_avg_height; }
+   float median_gain = median(gains, ntrks), median_height = median(heights, ntrks);
+   int worst = -1;
+   float worst_score = 0, next_score = 0;
+   for (int trk = 0; trk < ntrks; ++trk) {
+      struct trkstate_t *t = &trkstate[trk];
+      float blkscore = 0;
+      if (hits[trk] > 0) blkscore = (float)hits[trk] / maxhits; // the worst track in this block gets 1
+      else if (t->max_agc_gain > HEALTH_AGC_RATIO * median_gain
+               || t->v_avg_height < HEALTH_HEIGHT_RATIO * median_height) blkscore = 0.5f;
+      trkhealth[trk].score = HEALTH_DECAY * trkhealth[trk].score + (1 - HEALTH_DECAY) * blkscore;
+      if (trkhealth[trk].score > worst_score) {
+         next_score = worst_score;
+         worst_score = trkhealth[trk].score; worst = trk; }
+      else if (trkhealth[trk].score > next_score) next_score = trkhealth[trk].score; }
+   uint16_t suspect = 0;
+   if (worst >= 0 && worst_score >= HEALTH_NOMINATE && worst_score >= HEALTH_MARGIN * next_score) {
+      suspect = 1 << (ntrks - 1 - worst);
+      ++trkhealth[worst].nominated_blks; }
+   if (suspect != health_suspect) {
+      if (suspect) {
+         dlog("track health: nominating trk %d with score %.2f at %.8lf\n", worst, worst_score, timenow); }
+      else dlog("track health: no track is nominated at %.8lf\n", timenow); }
+   health_suspect = suspect; }
+
+void track_health_report(void) {
+   bool any = false;
+   for (int trk = 0; trk < ntrks; ++trk)
+      if (trkhealth[trk].nominated_blks > 0) {
+         if (!any) rlog("  the track health model nominated");
+         rlog("%s trk %d for %d block%s", any ? "," : "", trk, trkhealth[trk].nominated_blks, trkhealth[trk].nominated_blks != 1 ? "s" : "");
+         any = true; }
+   if (any) rlog("\n");
+   else rlog("  the track health model didn't nominate any tracks\n"); }
+
+int correct_parity_erasures(int length, bool use_faked) {
+   // For bytes with a parity error, if exactly one track is an erasure candidate because we faked its bit
+   // or its bit came from a low-confidence peak, then invert that bit. Return how many bytes we corrected.
+   // If there are several, the track nominated by the track health model breaks the tie if it is one of them.
+   // With no candidates at all we don't guess, even if a track is nominated. For NRZI the nominated track is
+   // only used by nrzi_correct_track(), where the CRC and LRC check it.
+   // The faked bits can't be used for NRZI, because it doesn't clear them for each block.
+   struct results_t *result = &block.results[block.parmset];
+   int numcorrected = 0;
+   for (int i = 0; i < length; ++i)
+      if (parity(data[i]) != expected_parity) {
+         uint16_t faked = use_faked ? data_faked[i] : 0;
+         uint16_t erasures = faked ? faked : data_weak[i]; // prefer bits we know we faked
+         uint16_t bits = erasures;
+         int count;
+         COUNTBITS(count, bits);
+         if (count >= 2 && mode != NRZI && erasures & health_suspect) {
+            erasures = health_suspect; // use the track that has been bad lately
+            faked &= health_suspect;
+            count = 1; }
+         if (count == 1) {
+            data[i] ^= erasures;
+            if (!faked) ++result->corrected_bits; // (faked bits were already counted)
+            data_faked[i] |= erasures;
+            result->faked_tracks |= erasures;
+            ++numcorrected; } }
+   if (numcorrected) dlog("corrected %d parity errors using erasure pointers\n", numcorrected);
+   return numcorrected; }
+
 void process_up_transition(struct trkstate_t *t) {
    //rlog("up transition on trk %d at %.8lf\n", t->trknum, t->t_top);
    TRACE(peak, t->t_top, UPTICK, t);
    process_transition(t);
+   t->confidence = peak_confidence(t, t->v_top, (float)(t->t_top - t->t_lastpeak), peak_spacing(t));
    if (doing_density_detection) {
       if (estden_transition(t, t->t_top, (float)(t->t_top - t->t_lastpeak)))
          block.results[block.parmset].blktype = BS_ABORTED; // got enough transitions for density detect
@@ -584,6 +1216,8 @@ void process_up_transition(struct trkstate_t *t) {
       else if (mode == NRZI) nrzi_top(t);
       else if (mode == GCR) gcr_top(t);
       else if (mode == WW) ww_top(t); }
+   if (restore_baseline) baseline_transition(t, true);
+   if (equalizing) equalizer_transition(t, t->t_top, true);
    t->v_lasttop = t->v_top;
    t->v_lastpeak = t->v_top;
    t->t_prevlastpeak = t->t_lastpeak;
@@ -593,6 +1227,7 @@ void process_down_transition(struct trkstate_t *t) {
    //rlog("dn transition on trk %d at %.8lf\n", t->trknum, t->t_bot);
    TRACE(peak, t->t_bot, DNTICK, t);
    process_transition(t);
+   t->confidence = peak_confidence(t, t->v_bot, (float)(t->t_bot - t->t_lastpeak), peak_spacing(t));
    if (doing_density_detection) {
       if (estden_transition(t, t->t_bot, (float)(t->t_bot - t->t_lastpeak)))
          block.results[block.parmset].blktype = BS_ABORTED; // got enough transitions for density detect
@@ -602,6 +1237,8 @@ void process_down_transition(struct trkstate_t *t) {
       else if (mode == NRZI) nrzi_bot(t);
       else if (mode == GCR) gcr_bot(t);
       else if (mode == WW) ww_bot(t); }
+   if (restore_baseline) baseline_transition(t, false);
+   if (equalizing) equalizer_transition(t, t->t_bot, false);
    t->v_lastbot = t->v_bot;
    t->t_lastbot = t->t_bot;
    t->v_lastpeak = t->v_bot;
@@ -90,12 +90,21 @@ typedef unsigned char byte;
 #define MINTRKS 5
 #define MAXBLOCK 131072
 #define MAXPARMSETS 15
-#define MAXPARMS 15
+#define MAXPARMS 25
 #define MAXPATH 300
 #define MAXLINE 400
 
 #define MAXSKEWSAMP 50     // maximum track skew amount in number of samples
 #define MAXSKEWBLKS 100    // maximum blocks to preprocess to calibrate skew
+#define MAXRETRYBLKS 10000 // maximum blocks to queue for retries in -twophase mode
+#define MAXFUSE 8          // maximum number of captures for -fuse
+#define FUSE_MINVOTERS 3   // minimum number of same-length bad decodings for a -fuse byte vote
+#define FUSE_LOOKAHEAD 4   // how many records ahead -fuse looks to realign a capture
+#define MANIFEST_FIELDS 13 // the number of fields in a -manifest record line
+#define FOLLOW_DEFAULT_SECS 30 // for -follow, how long to wait for more data before deciding the file is done
+#define FOLLOW_POLL_MSEC 500   // and how often to check
+#define REPLAY_HIST_BINS 14    // number of bins in the -replay latency histogram
+#define BIDIR_AGREE_BYTES 8    // for -bidir, how many bytes the forward and backward decodings must agree on
 #define MINSKEWTRANS 1000  // the minumum number of transitions we would like to base skew calibration on
 
 // Here are lots of of parameters that control the decoding algorithm.
@@ -140,7 +149,10 @@ enum wwtrk_t { // Whirlwind track types
 
 #define PEAK_THRESHOLD   0.005f     // volts of difference that define "same peak", scaled by AGC
 #define CLKRATE_WINDOW   50         // maximum window width for clock averaging
+#define PLL_DAMPING      0.707f     // clock PLL damping factor (critically damped is 1.0)
+#define PLL_MAX_DEVIATION 0.25f     // clock PLL period is kept within this fraction of the nominal bit spacing
 #define FAKE_BITS        true       // should we fake bits during a dropout?
+#define WEAK_CONFIDENCE  0.35f      // with -correct, bits from peaks with less confidence (0..1) than this are erasure candidates
 #define USE_ALL_PARMSETS false      // should we try to use all the parameter sets, to be able to rate them?
 
 #define SKIP_NOISE       true       // should we skip a noise block whenever we decode one, or try with alternate decodings?
@@ -182,13 +194,27 @@ struct sample_t {       // what we get from the digitizer hardware:
    float voltage[MAXTRKS]; // the voltage level from each track head
 };
 
+struct file_position_t {   // for saving and restoring the file position, sample time, and number of samples
+   int64_t position;
+   double time;
+   int64_t time_ns;
+   uint64_t nsamples; };
+
+struct manifest_rec_t {    // a record from an earlier run's -manifest file, for -redecode
+   bool tapemark, unusable;   // (an unusable block has no record in the .tap file)
+   int length, errcount, warncount, parmset;
+   double tstart, tend;
+   struct file_position_t start; }; // where the decoder started looking for it
+
 struct clkavg_t { // structure for keeping track of clock rate
    // For PE and GCR, there is one of these for each track.
    // For NRZI there is is only one of these, in the nrzi_t structure.
-   // We either do window averaging or exponential averaging, depending on parms.
+   // We either do window averaging, exponential averaging, or a phase-locked loop, depending on parms.
    float t_bitspacing[CLKRATE_WINDOW];  // last n bit time spacing
    int bitndx;  // index into t_bitspacing of next spot to use
    float t_bitspaceavg;  // current avg of bit time spacing
+   float t_pll_period;   // PLL: the loop's current bit period (the "frequency" integrator)
+   float t_pll_phase;    // PLL: how late the last transition was relative to the loop's prediction, after correction
 };
 
 struct trkstate_t {  // track-by-track decoding state
@@ -245,6 +271,7 @@ struct trkstate_t {  // track-by-track decoding state
    int datacount;          // how many data bits we've seen
    int peakcount;          // how many peaks (flux reversals) we've seen
    byte lastdatabit;       // the last data bit we recorded
+   float confidence;       // how much we believe the last peak (0..1), based on its height, timing, and the AGC gain
    bool idle;              // are we idle, ie not seeing transitions?
    bool clknext;           // PE: do we expect a clock next?
 // bool hadbit;            // NRZI: did we have a bit transition since the last check?
@@ -252,6 +279,8 @@ struct trkstate_t {  // track-by-track decoding state
 
    byte lastbits;          // GCR: accumulate the last bits we decoded, so we can recognize control subgroups on the fly
    int  resync_bitcount;   // GCR: how many bits into resync are we?
+   int ps_prevcells;       // -peakshift: how many bit cells were between the previous two transitions, or 0 if unknown
+   int ps_cells;           // -peakshift: NRZI: how many bit cells since the last transition
 };
 
 // For PE and GCR, which are self-clocking, the clock for each track is separately computed.
@@ -302,6 +331,7 @@ struct parms_t {  // a set of parameters used for decoding a block. We try again
    float midbit;           // NRZI: what fraction of a bit time is the midbit point for determining zeroes
    float z1pt;             // GCR: fraction of a bit time that means one zero bit
    float z2pt;             // GCR: fraction of a bit time that means two zero bits
+   float pll_bw;           // clock PLL loop bandwidth as a fraction of the bit rate; 0 means use clk_window or clk_alpha
    // ...add more dynamic parameters above here, and in the arrays at the top of decoder.c
    char id[4];             // "PRM", to make sure the structure initialization isn't screwed up
    char comment[MAXPARMCOMMENT]; // saved comment for this parmset
@@ -338,6 +368,7 @@ struct blkstate_t {  // state of the block, when we're done
       int missed_midbits;        //    how many times transitions were recognized after the midbit
       int corrected_bits;        //    how many correct (or ec) bits we generated
       int gcr_bad_dgroups;       //    GCR: how many bad dgroups we found and guessed about
+      int gcr_ml_changes;        //    GCR: how many zero counts the sequence detector changed
       int ww_leading_clock;      //    WW: the block had one spurious leading clock bit (length mod 8 = 1)
       int ww_missing_onebit;     //    WW: instances where a 1-bit was only on one of the data tracks
       int ww_missing_clock;      //    WW: instances where a clock only appeared on one of the clock tracks
@@ -351,8 +382,9 @@ struct blkstate_t {  // state of the block, when we're done
       int gcr_bad_sequence;      //    GCR: how many sgroup sequence errors we found
       int ww_bad_length;         //    WW: the block had bad length (mod 8 isn't 0 or 1)
       int ww_speed_err;          //    WW: the clock speed got out of whack
-      int first_error;           // GCR: the datacount where we found the first error in the block
-      int crc, lrc;              // NRZI 800; the actual crc anc lrc values in the data
+      int tbin_damaged;          //    .tbin: the samples came from a data chunk with a bad checksum
+      int first_error;           // GCR, PE: the datacount where we found the first error in the block
+      int crc, lrc;              // NRZI 800; the actual crc anc lrc values in the data. GCR: the CRC and auxiliary CRC chars
       float alltrk_max_agc_gain; // the maximum AGC gain we used for any track
       float alltrk_min_agc_gain; // the minumum AGC gain we used for any track
    } results [MAXPARMSETS]; // results for each parmset we tried
@@ -377,20 +409,55 @@ void set_expected_parity(int blklength);
 void adjust_clock(struct clkavg_t *c, float delta, int trk);
 void force_clock(struct clkavg_t *c, float delta, int trk);
 void adjust_agc(struct trkstate_t *t);
+float peak_confidence(struct trkstate_t *t, float v_peak, float t_delta, float t_unit);
+void mark_weak_bit(struct trkstate_t *t, int ndx, bool weak);
+int correct_parity_erasures(int length, bool use_faked);
 void accumulate_avg_height(struct trkstate_t *t);
 void compute_avg_height(struct trkstate_t *t);
 void record_peakstat(float bitspacing, float peaktime, int trknum);
 void adjust_deskew(float bitspacing);
+void speed_model_init(void);
+void speed_model_update(float bitspacing, double time);
+float initial_bitspacing(void);
+void speed_model_report(void);
+void track_health_init(void);
+void track_health_update(int length);
+void track_health_report(void);
+void baseline_init(void);
+void baseline_start_block(void);
+void baseline_block_done(void);
+void baseline_restore(struct sample_t *psample);
+void baseline_transition(struct trkstate_t *t, bool up);
+void baseline_report(void);
+void equalizer_init(void);
+void equalizer_start_block(void);
+void equalizer_block_done(bool clean);
+void equalizer_transition(struct trkstate_t *t, double t_peak, bool up);
+void equalize(struct sample_t *psample, int trk);
+void equalizer_report(void);
+void peakshift_init(void);
+void peakshift_start_block(void);
+float peakshift_correction(struct trkstate_t *t, int cells, float cellwidth);
+void peakshift_record(struct trkstate_t *t, float deviation, int cells, float cellwidth);
+void peakshift_block_done(bool clean);
+void peakshift_report(void);
+void models_init(void);
+void models_start_block(void);
+void models_block_done(int length, bool clean);
+void models_report(void);
 enum bstate_t process_sample(struct sample_t *);
 void gcr_top(struct trkstate_t *t);
 void gcr_bot(struct trkstate_t *t);
 void gcr_end_of_block(void);
 void gcr_preprocess(void);
 void gcr_write_ecc_data(void);
+int gcr_compute_crc(uint16_t *bytes, int dgroups);
 void nrzi_top(struct trkstate_t *t);
 void nrzi_bot(struct trkstate_t *t);
 void nrzi_zerocheck(void);
 void nrzi_end_of_block(void);
+int nrzi_crc_step(int crc, uint16_t val);
+void nrzi_compute_crc_lrc(int length, uint16_t fixmask, int *pcrc, int *plrc);
 void pe_top(struct trkstate_t *t);
 void pe_bot(struct trkstate_t *t);
 void pe_generate_fake_bits(struct trkstate_t *t);
@@ -411,7 +478,9 @@ void skew_display(void);
 bool skew_compute_deskew(bool do_set);
 int skew_min_transitions(void);
 void estden_init(void);
+void estden_init_format(void);
 void estden_setdensity(int numblks);
+enum mode_t estden_format(float *pbpi);
 void estden_show(void);
 //bool estden_numtransitions(void);
 bool estden_done(void);
@@ -426,16 +495,34 @@ void txtfile_message(const char *msg,...);
 void txtfile_close(void);
 char * format_block_errors(struct results_t *result);
 void read_tapfile(const char *basefilename, const char *extension);
+void fuse_start_capture(void);
+void fuse_add_record(bool tapemark, int length, int errcount, int warncount, int64_t offset);
+void fuse_captures(void);
+void manifest_open(void);
+void manifest_start_file(void);
+void manifest_data(const byte *buf, int length);
+void manifest_record(bool tapemark, const byte *buf, int length, double tstart, double tend,
+                     int errcount, int warncount, int parmset, struct file_position_t *start);
+void manifest_unusable(double tstart, double tend, int errcount, int warncount, int parmset,
+                       struct file_position_t *start);
+void manifest_end_file(const char *filename);
+void manifest_close(void);
+void redecode_open(const char *basefilename);
+struct manifest_rec_t *redecode_next(byte *buf);
+struct manifest_rec_t *redecode_peek(void);
+void redecode_close(void);
 
 extern enum mode_t mode;
 extern enum wwtrk_t ww_trk_to_type[MAXTRKS];
 extern int ww_type_to_trk[WWTRK_NUMTYPES];
-extern bool verbose, quiet, multiple_tries, tap_format, tap_read, do_correction, do_differentiate, labels;
-extern bool deskew, adjdeskew, doing_deskew, skew_given, doing_density_detection, find_zeros;
+extern bool verbose, quiet, multiple_tries, tap_format, tap_read, do_correction, do_differentiate, do_viterbi, labels;
+extern bool deskew, adjdeskew, speed_drift, track_health, equalizing, restore_baseline, learn_peakshift, doing_deskew, skew_given, doing_density_detection, find_zeros;
 extern bool trace_on, trace_start;
 extern bool hdr1_label, reverse_tape, invert_data, autoinvert_data, txtfile_verbose;
+extern bool bidir_backward, bidir_bit1_up[];
 extern byte expected_parity, specified_parity;
 extern int revparity;
+extern float pll_bw_override;
 extern enum flux_direction_t flux_direction_requested, flux_direction_current;
 extern int dlog_lines, verbose_level, debug_level;
 extern double timenow, torigin;
@@ -447,7 +534,8 @@ extern struct blkstate_t block;
 extern struct trkstate_t trkstate[MAXTRKS];
 extern int skew_delaycnt[MAXTRKS];
 extern float deskew_max_delay_percent;
-extern uint16_t data[], data_faked[];
+extern uint16_t data[], data_faked[], data_weak[], health_suspect;
+extern bool gcr_bad_bytes[];
 extern double data_time[];
 extern struct nrzi_t nrzi;
 extern struct ww_t ww;
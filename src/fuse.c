@@ -0,0 +1,235 @@
+//file: fuse.c
+/******************************************************************************
+
+Fuse several captures of the same tape into one SIMH .tap file.
+
+With -fuse, readtape is given two or more input files that are separate
+captures of the same tape, perhaps from repeated passes through the drive.
+Each is decoded as usual into its own .tap file, and while that happens we
+remember the type, length, error count, and warning count of every record,
+and where its data is in that capture's .tap file.
+
+Then we walk through the records of all the captures in step, aligning them
+by sequence and length. For each record we use the first capture whose
+decoding had no errors. If none did, and at least FUSE_MINVOTERS captures
+have a decoding of the same length, we take a majority vote of the bytes.
+Otherwise we use the decoding with the fewest errors. Records that can't be
+verified are still marked with the .tap error flag.
+
+If a capture has a record that doesn't match what the others have at that
+point, we look ahead a few records for a match. A good record that only one
+capture has is kept, on the theory that the other captures missed it; a bad
+one is assumed to be noise and is dropped.
+
+The result is written to <basefilename>.fused.tap, using the name of the
+first capture.
+
+*******************************************************************************
+Copyright (C) 2026 Len Shustek
+
+The MIT License (MIT): Permission is hereby granted, free of charge, to any
+person obtaining a copy of this software and associated documentation files
+(the "Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include "decoder.h"
+
+#if defined(_WIN32)
+#define fseeko _fseeki64
+#endif
+
+struct fuse_rec_t {     // one record decoded from a capture
+   bool tapemark;       // is it a tapemark?
+   int length;          // the data length
+   int errcount;        // how many errors it had
+   int warncount;       // how many warnings it had
+   int64_t offset; };   // where its leading length marker is in the capture's .tap file, or -1 if it wasn't written
+
+struct capture_t {      // one capture of the tape
+   char filename[MAXPATH];       // its .tap file
+   FILE *tapf;                   // which we reopen for reading
+   struct fuse_rec_t *recs;      // all its records
+   int numrecs, numalloc;
+   int next;                     // the next record to align
+   int used, skipped; }          // statistics
+captures[MAXFUSE];
+
+int fuse_numcaptures = 0;
+static FILE *fusef;
+static byte fuse_buf[MAXFUSE][MAXBLOCK];
+
+void fuse_start_capture(void) { // we're about to decode the next capture
+   assert(fuse_numcaptures < MAXFUSE, "too many captures to fuse; the maximum is %d", MAXFUSE);
+   struct capture_t *c = &captures[fuse_numcaptures++];
+   snprintf(c->filename, MAXPATH, "%s.tap", baseoutfilename);
+   c->numrecs = c->next = c->used = c->skipped = 0; }
+
+void fuse_add_record(bool tapemark, int length, int errcount, int warncount, int64_t offset) {
+   // remember a tapemark or data block that the current capture is writing
+   struct capture_t *c = &captures[fuse_numcaptures - 1];
+   if (c->numrecs >= c->numalloc) {
+      c->numalloc = c->numalloc == 0 ? 1000 : 2 * c->numalloc;
+      c->recs = realloc(c->recs, c->numalloc * sizeof(struct fuse_rec_t));
+      assert(c->recs != NULLP, "can't allocate %d records for -fuse", c->numalloc); }
+   struct fuse_rec_t *r = &c->recs[c->numrecs++];
+   r->tapemark = tapemark;
+   r->length = length;
+   r->errcount = errcount;
+   r->warncount = warncount;
+   r->offset = offset; }
+
+static bool rec_good(struct fuse_rec_t *r) {
+   return r->tapemark || (r->errcount == 0 && r->offset >= 0); }
+
+static bool rec_match(struct fuse_rec_t *a, struct fuse_rec_t *b) { // could these be decodings of the same record?
+   if (a->tapemark || b->tapemark) return a->tapemark == b->tapemark;
+   return a->length == b->length || !rec_good(a) || !rec_good(b); } // (errors can change the length)
+
+static void read_record(struct capture_t *c, struct fuse_rec_t *r, byte *buf) {
+   assert(fseeko(c->tapf, r->offset + 4, SEEK_SET) == 0, "fseek failed in %s", c->filename);
+   assert(fread(buf, 1, r->length, c->tapf) == r->length, "can't read %d bytes at offset %lld in %s",
+          r->length, (long long)r->offset, c->filename); }
+
+static void put_marker(uint32_t num) { // a 4-byte little-endian .tap marker, like output_tap_marker()
+   for (int i = 0; i < 4; ++i) {
+      byte lsb = num & 0xff;
+      assert(fwrite(&lsb, 1, 1, fusef) == 1, "fwrite failed in put_marker");
+      num >>= 8; } }
+
+static void put_record(byte *buf, int length, bool err) {
+   uint32_t errflag = err ? 0x80000000 : 0;
+   put_marker(length | errflag);
+   assert(fwrite(buf, 1, length, fusef) == length, "fused data write failed");
+   if (length & 1) { // (tap format needs an even number of data bytes)
+      byte zero = 0;
+      assert(fwrite(&zero, 1, 1, fusef) == 1, "fused odd byte write failed"); }
+   put_marker(length | errflag); }
+
+static void put_from_capture(int cnum, struct fuse_rec_t *r) { // copy a record from one capture
+   if (r->tapemark) put_marker(0);
+   else {
+      read_record(&captures[cnum], r, fuse_buf[0]);
+      put_record(fuse_buf[0], r->length, r->errcount > 0); }
+   ++captures[cnum].used; }
+
+// decode a bad record from all the captures that have it; return true if we voted
+static bool fuse_bad_record(int nmembers, int members[], struct fuse_rec_t *recs[]) {
+   int best = -1, length = 0, nvoters = 0;
+   for (int i = 0; i < nmembers; ++i) { // find the most common length, favoring the fewest errors
+      if (recs[i]->offset < 0) continue; // (it was unusable, so there's no data)
+      int count = 0;
+      for (int j = 0; j < nmembers; ++j)
+         if (recs[j]->offset >= 0 && recs[j]->length == recs[i]->length) ++count;
+      if (count > nvoters || (count == nvoters && recs[i]->errcount < recs[best]->errcount)) {
+         best = i;
+         length = recs[i]->length;
+         nvoters = count; } }
+   if (best < 0) return false; // no capture has any data for this block
+   if (nvoters < FUSE_MINVOTERS) { // not enough for a vote, so use the one with the fewest errors
+      int fewest = best;
+      for (int i = 0; i < nmembers; ++i)
+         if (recs[i]->offset >= 0 && recs[i]->errcount < recs[fewest]->errcount) fewest = i;
+      put_from_capture(members[fewest], recs[fewest]);
+      return false; }
+   int voters[MAXFUSE], nv = 0;
+   voters[nv++] = best; // the one with the fewest errors goes first, to win ties
+   for (int i = 0; i < nmembers; ++i)
+      if (i != best && recs[i]->offset >= 0 && recs[i]->length == length) voters[nv++] = i;
+   for (int i = 0; i < nv; ++i)
+      read_record(&captures[members[voters[i]]], recs[voters[i]], fuse_buf[i]);
+   static byte voted[MAXBLOCK];
+   for (int ndx = 0; ndx < length; ++ndx) {
+      int chosen = 0, chosen_count = 0;
+      for (int i = 0; i < nv; ++i) {
+         int count = 0;
+         for (int j = 0; j < nv; ++j) if (fuse_buf[j][ndx] == fuse_buf[i][ndx]) ++count;
+         if (count > chosen_count) {
+            chosen = i;
+            chosen_count = count; } }
+      voted[ndx] = fuse_buf[chosen][ndx]; }
+   put_record(voted, length, true); // (we can't tell whether the vote got it right)
+   return true; }
+
+void fuse_captures(void) { // fuse all the captures into one .tap file
+   char filename[MAXPATH];
+   int numrecs = 0, numfromothers = 0, numvoted = 0, numbad = 0, numunusable = 0;
+   for (int k = 0; k < fuse_numcaptures; ++k) {
+      struct capture_t *c = &captures[k];
+      c->tapf = NULLP;
+      if (c->numrecs > 0) {
+         c->tapf = fopen(c->filename, "rb");
+         assert(c->tapf != NULLP, "can't reopen %s for -fuse", c->filename); } }
+   snprintf(filename, MAXPATH, "%.*s.fused.tap", (int)strlen(captures[0].filename) - 4, captures[0].filename); // (replace ".tap")
+   fusef = fopen(filename, "wb");
+   assert(fusef != NULLP, "can't create %s", filename);
+   rlog("\nfusing %d captures into \"%s\"\n", fuse_numcaptures, filename);
+
+   while (1) {
+      int ref = -1;
+      for (int k = 0; k < fuse_numcaptures && ref < 0; ++k) // the reference is the first capture with a good next record
+         if (captures[k].next < captures[k].numrecs && rec_good(&captures[k].recs[captures[k].next])) ref = k;
+      for (int k = 0; k < fuse_numcaptures && ref < 0; ++k) // or the first one with any next record
+         if (captures[k].next < captures[k].numrecs) ref = k;
+      if (ref < 0) break; // all done
+      struct fuse_rec_t *refrec = &captures[ref].recs[captures[ref].next];
+      int members[MAXFUSE], nmembers = 0;
+      struct fuse_rec_t *recs[MAXFUSE];
+      for (int k = 0; k < fuse_numcaptures; ++k) { // find the matching record in each capture
+         struct capture_t *c = &captures[k];
+         if (c->next >= c->numrecs) continue;
+         int ahead;
+         for (ahead = 0; ahead <= FUSE_LOOKAHEAD && c->next + ahead < c->numrecs; ++ahead)
+            if (rec_match(&c->recs[c->next + ahead], refrec)) break;
+         if (c->next + ahead >= c->numrecs || ahead > FUSE_LOOKAHEAD) continue; // not there: it missed this one
+         for (int i = 0; i < ahead; ++i, ++c->next) { // records before the match are extra
+            struct fuse_rec_t *r = &c->recs[c->next];
+            if (rec_good(r)) { // keep a good one that the others missed
+               if (verbose) rlog("  record %d of capture %d isn't in the other captures, but is good\n", c->next + 1, k + 1);
+               put_from_capture(k, r);
+               ++numrecs; }
+            else {
+               if (verbose) rlog("  record %d of capture %d isn't in the other captures, and was dropped\n", c->next + 1, k + 1);
+               ++c->skipped; } }
+         members[nmembers] = k;
+         recs[nmembers++] = &c->recs[c->next++]; }
+      if (rec_good(refrec)) { // use the first capture that decoded it well, with as few warnings as possible
+         int chosen = -1;
+         for (int i = 0; i < nmembers; ++i)
+            if (rec_good(recs[i]) && rec_match(recs[i], refrec)
+                  && (chosen < 0 || recs[i]->warncount < recs[chosen]->warncount)) chosen = i;
+         put_from_capture(members[chosen], recs[chosen]);
+         if (members[chosen] != 0 && !refrec->tapemark) ++numfromothers; }
+      else {
+         if (fuse_bad_record(nmembers, members, recs)) ++numvoted;
+         else {
+            bool written = false;
+            for (int i = 0; i < nmembers; ++i) if (recs[i]->offset >= 0) written = true;
+            if (!written) ++numunusable; }
+         ++numbad;
+         if (verbose) rlog("  record %d is bad in all %d captures that have it\n", numrecs + 1, nmembers); }
+      ++numrecs; }
+
+   put_marker(0xffffffffl);
+   fclose(fusef);
+   for (int k = 0; k < fuse_numcaptures; ++k) {
+      struct capture_t *c = &captures[k];
+      if (c->tapf) fclose(c->tapf);
+      rlog("  capture %d, \"%s\", had %d record%s; %d %s used and %d %s dropped\n",
+           k + 1, c->filename, c->numrecs, add_s(c->numrecs), c->used, c->used == 1 ? "was" : "were", c->skipped, c->skipped == 1 ? "was" : "were"); }
+   rlog("  the fused tape has %d record%s, and %d data block%s bad in all captures\n",
+        numrecs - numunusable, add_s(numrecs - numunusable), numbad, numbad == 1 ? " was" : "s were");
+   rlog("  %d block%s from a capture other than the first, and %d bad block%s decoded by voting\n",
+        numfromothers, numfromothers == 1 ? " came" : "s came", numvoted, numvoted == 1 ? " was" : "s were");
+   if (numunusable) rlog("  %d block%s unusable in all captures and not written\n", numunusable, numunusable == 1 ? " was" : "s were"); }
+//*
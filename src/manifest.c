@@ -0,0 +1,252 @@
+//file: manifest.c
+/******************************************************************************
+
+Create a manifest of the records written during decoding.
+
+With -manifest, readtape writes <basefilename>.manifest.csv with one line
+for each data block and tapemark as it is written: the record number, the
+block number, the length, the times the record started and ended in the
+sample data, the error and warning counts, the parmset used, the
+SHA-256 hash of the data bytes, and where in the input file the decoder
+started looking for the record. A block that was too damaged to write
+gets a line too, with no record number, "unusable" for the block number,
+and a length of 0, so that -redecode will try it again.
+
+When each output file is closed, a line with its name, its length, and
+the SHA-256 hash of the whole file is added. For a .tap file that covers
+the record length markers too, so it matches what a separate fingerprinting
+program would compute by reading the file again afterwards.
+
+The hashing is done on the bytes as they are written, so it costs very
+little compared to the decoding.
+
+With -redecode, we read the manifest and the .tap file from an earlier run
+and give readtape the records one at a time. Those that were perfect are
+copied to the new .tap file, and those that weren't are decoded again
+starting at the remembered input file position. That makes it much faster
+to try new parmsets on a tape that mostly decoded well.
+
+*******************************************************************************
+Copyright (C) 2026 Len Shustek
+
+The MIT License (MIT): Permission is hereby granted, free of charge, to any
+person obtaining a copy of this software and associated documentation files
+(the "Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include "decoder.h"
+
+/********************************************************************
+   SHA-256, from the FIPS 180-4 specification
+*********************************************************************/
+struct sha256_t {
+   uint32_t state[8];
+   uint64_t length;        // total bytes hashed
+   byte buf[64];           // the partial chunk
+   int buflen; };
+
+static const uint32_t sha256_k[64] = {
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+   0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+   0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+   0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+   0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+   0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+#define ROTR(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_init(struct sha256_t *s) {
+   static const uint32_t initial[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+   memcpy(s->state, initial, sizeof(initial));
+   s->length = 0;
+   s->buflen = 0; }
+
+static void sha256_chunk(struct sha256_t *s, const byte *p) { // process one 64-byte chunk
+   uint32_t w[64], a, b, c, d, e, f, g, h;
+   for (int i = 0; i < 16; ++i)
+      w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+   for (int i = 16; i < 64; ++i) {
+      uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1; }
+   a = s->state[0]; b = s->state[1]; c = s->state[2]; d = s->state[3];
+   e = s->state[4]; f = s->state[5]; g = s->state[6]; h = s->state[7];
+   for (int i = 0; i < 64; ++i) {
+      uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+      uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2; }
+   s->state[0] += a; s->state[1] += b; s->state[2] += c; s->state[3] += d;
+   s->state[4] += e; s->state[5] += f; s->state[6] += g; s->state[7] += h; }
+
+static void sha256_update(struct sha256_t *s, const byte *p, int len) {
+   s->length += len;
+   if (s->buflen > 0) { // finish a partial chunk first
+      while (len > 0 && s->buflen < 64) {
+         s->buf[s->buflen++] = *p++;
+         --len; }
+      if (s->buflen < 64) return;
+      sha256_chunk(s, s->buf);
+      s->buflen = 0; }
+   for (; len >= 64; len -= 64, p += 64) sha256_chunk(s, p);
+   memcpy(s->buf, p, len);
+   s->buflen = len; }
+
+static void sha256_final(struct sha256_t *s, char *hex) { // return the hash as 64 hex characters
+   uint64_t bits = s->length * 8;
+   byte pad = 0x80;
+   sha256_update(s, &pad, 1);
+   pad = 0;
+   while (s->buflen != 56) sha256_update(s, &pad, 1);
+   byte lenbytes[8];
+   for (int i = 0; i < 8; ++i) lenbytes[i] = (byte)(bits >> (56 - 8 * i));
+   sha256_update(s, lenbytes, 8);
+   for (int i = 0; i < 8; ++i) sprintf(hex + 8 * i, "%08x", s->state[i]);
+   hex[64] = '\0'; }
+
+/********************************************************************
+   the manifest file
+*********************************************************************/
+static FILE *manf = NULLP;
+static struct sha256_t file_hash;
+static int64_t file_bytes;
+static int manifest_numrecs;
+
+void manifest_open(void) {
+   char filename[MAXPATH];
+   snprintf(filename, MAXPATH, "%s.manifest.csv", baseoutfilename);
+   assert((manf = fopen(filename, "w")) != NULLP, "can't create manifest file \"%s\"", filename);
+   fprintf(manf, "record, block, length, start time, end time, errors, warnings, parmset, SHA-256, "
+           "search position, search time, search time ns, search samples\n");
+   manifest_numrecs = 0; }
+
+void manifest_start_file(void) { // a new output file was created
+   sha256_init(&file_hash);
+   file_bytes = 0; }
+
+void manifest_data(const byte *buf, int length) { // bytes were written to the output file
+   sha256_update(&file_hash, buf, length);
+   file_bytes += length; }
+
+void manifest_record(bool tapemark, const byte *buf, int length, double tstart, double tend,
+                     int errcount, int warncount, int parmset, struct file_position_t *start) { // a record was written
+   if (tapemark) fprintf(manf, "%d, tapemark, 0, %.8lf, %.8lf, 0, 0, , ", ++manifest_numrecs, tstart, tend);
+   else {
+      struct sha256_t rec_hash;
+      char hex[65];
+      sha256_init(&rec_hash);
+      sha256_update(&rec_hash, buf, length);
+      sha256_final(&rec_hash, hex);
+      fprintf(manf, "%d, %d, %d, %.8lf, %.8lf, %d, %d, %d, %s",
+              ++manifest_numrecs, numblks + 1, length, tstart, tend, errcount, warncount, parmset, hex); }
+   fprintf(manf, ", %lld, %.10lf, %lld, %llu\n", (long long)start->position, start->time,
+           (long long)start->time_ns, (unsigned long long)start->nsamples); }
+
+void manifest_unusable(double tstart, double tend, int errcount, int warncount, int parmset,
+                       struct file_position_t *start) { // a block was too damaged to write, so there is no record
+   fprintf(manf, ", unusable, 0, %.8lf, %.8lf, %d, %d, %d, , %lld, %.10lf, %lld, %llu\n",
+           tstart, tend, max(errcount, 1), warncount, parmset, (long long)start->position, start->time,
+           (long long)start->time_ns, (unsigned long long)start->nsamples); }
+
+void manifest_end_file(const char *filename) { // an output file was closed
+   char hex[65];
+   sha256_final(&file_hash, hex);
+   fprintf(manf, "file, \"%s\", %lld, , , , , , %s\n", filename, (long long)file_bytes, hex); }
+
+void manifest_close(void) {
+   if (manf) fclose(manf);
+   manf = NULLP; }
+
+/********************************************************************
+   reading an earlier manifest and .tap file for -redecode
+*********************************************************************/
+static struct manifest_rec_t *redo_recs = NULLP;
+static int redo_numrecs, redo_numalloc, redo_next, redo_recnum;
+static FILE *redo_tapf;
+static char redo_tapname[MAXPATH];
+
+static uint32_t redo_get_marker(void) { // a 4-byte little-endian .tap marker
+   byte chs[4];
+   assert(fread(chs, 1, 4, redo_tapf) == 4, "%s ended too soon", redo_tapname);
+   return (uint32_t)chs[3] << 24 | (uint32_t)chs[2] << 16 | (uint32_t)chs[1] << 8 | chs[0]; }
+
+void redecode_open(const char *basefilename) {
+   char filename[MAXPATH], line[MAXLINE + 1];
+   snprintf(filename, MAXPATH, "%s.manifest.csv", basefilename);
+   FILE *f = fopen(filename, "r");
+   assert(f != NULLP, "can't open manifest file \"%s\" for -redecode", filename);
+   redo_numrecs = redo_next = redo_recnum = 0;
+   int linenum = 0;
+   while (fgets(line, MAXLINE, f)) {
+      ++linenum;
+      if (!isdigit(line[0]) && line[0] != ',') continue; // skip the heading and the output file lines (unusable blocks have no record number)
+      if (redo_numrecs >= redo_numalloc) {
+         redo_numalloc = redo_numalloc == 0 ? 1000 : 2 * redo_numalloc;
+         redo_recs = realloc(redo_recs, redo_numalloc * sizeof(struct manifest_rec_t));
+         assert(redo_recs != NULLP, "can't allocate %d records for -redecode", redo_numalloc); }
+      struct manifest_rec_t *r = &redo_recs[redo_numrecs++];
+      char *field[MANIFEST_FIELDS];
+      int nfields = 0;
+      for (char *p = line; nfields < MANIFEST_FIELDS; ++p) { // split the line at the commas
+         field[nfields++] = p;
+         if ((p = strchr(p, ',')) == NULLP) break;
+         *p = '\0'; }
+      assert(nfields == MANIFEST_FIELDS, "bad line %d in %s; it must be from a -manifest of version 3.17 or later", linenum, filename);
+      r->tapemark = strstr(field[1], "tapemark") != NULLP;
+      r->unusable = strstr(field[1], "unusable") != NULLP;
+      r->length = atoi(field[2]);
+      r->tstart = atof(field[3]);
+      r->tend = atof(field[4]);
+      r->errcount = atoi(field[5]);
+      r->warncount = atoi(field[6]);
+      r->parmset = atoi(field[7]);
+      r->start.position = strtoll(field[9], NULLP, 10);
+      r->start.time = atof(field[10]);
+      r->start.time_ns = strtoll(field[11], NULLP, 10);
+      r->start.nsamples = strtoull(field[12], NULLP, 10); }
+   fclose(f);
+   snprintf(redo_tapname, MAXPATH, "%s.tap", basefilename);
+   assert((redo_tapf = fopen(redo_tapname, "rb")) != NULLP, "can't open \"%s\" for -redecode", redo_tapname);
+   rlog("-redecode will use %d records from \"%s\" and \"%s\"\n", redo_numrecs, filename, redo_tapname); }
+
+struct manifest_rec_t *redecode_next(byte *buf) {
+   // return the next record of the earlier run and read its data, or return NULLP at the end
+   if (redo_next >= redo_numrecs) return NULLP;
+   struct manifest_rec_t *r = &redo_recs[redo_next++];
+   if (r->unusable) return r; // (there is no record in the .tap file)
+   uint32_t marker = redo_get_marker();
+   ++redo_recnum;
+   if (r->tapemark) assert(marker == 0, "%s doesn't have the tapemark that record %d should be", redo_tapname, redo_recnum);
+   else {
+      assert((int)(marker & 0x00ffffff) == r->length, "record %d in %s is %d bytes, but the manifest says %d",
+             redo_recnum, redo_tapname, marker & 0x00ffffff, r->length);
+      assert(fread(buf, 1, r->length, redo_tapf) == r->length, "%s ended too soon", redo_tapname);
+      if (r->length & 1) assert(fgetc(redo_tapf) != EOF, "%s ended too soon", redo_tapname); // (the pad byte)
+      assert(redo_get_marker() == marker, "record %d in %s has mismatched lengths", redo_recnum, redo_tapname); }
+   return r; }
+
+struct manifest_rec_t *redecode_peek(void) { // what will the next record be?
+   return redo_next < redo_numrecs ? &redo_recs[redo_next] : NULLP; }
+
+void redecode_close(void) {
+   if (redo_tapf) fclose(redo_tapf);
+   redo_tapf = NULLP;
+   free(redo_recs);
+   redo_recs = NULLP;
+   redo_numalloc = 0; }
+
+//*
@@ -71,50 +71,51 @@ parms[] = { // list of: type, name, min_value, max_value
    DEFINE_PARM(P_FLT, midbit, NRZI, 0.0, 1.0),
    DEFINE_PARM(P_FLT, z1pt, GCR, 1.0, 2.0),
    DEFINE_PARM(P_FLT, z2pt, GCR, 2.0, 3.0),
+   DEFINE_PARM(P_FLT, pll_bw, ALLMODES, 0.0, 0.5),
    DEFINE_PARM(P_STR, id, ALLMODES, 0, 0),
    {P_END } };
 
 struct parms_t parmsets_PE[MAXPARMSETS] = {  0 }; // where we store the PE default parmsets
 char *parmcmds_PE[MAXPARMSETS] = { // commands to set defaults for PE
-   "parms active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, clk_factor, pulse_adj, pkww_bitfrac, pkww_rise, id",
-   "{       1,       0,         0.2,            5,     0.0,       0.0,      1.50,       0.4,          0.7,       0.10,  PRM }",
-   "{       1,       0,         0.2,            5,     0.0,       0.1,      1.50,       0.4,          0.7,       0.10,  PRM }",
-   "{       1,       3,         0.0,            5,     0.0,       0.0,      1.40,       0.0,          0.7,       0.10,  PRM }", // works on block 5, but not with pulseadj=0.2
-   "{       1,       3,         0.0,            5,     0.0,       0.0,      1.40,       0.2,          0.7,       0.10,  PRM }",
-   "{       1,       5,         0.0,            5,     0.0,       0.0,      1.40,       0.0,          0.7,       0.10,  PRM }",
-   "{       1,       5,         0.0,            5,     0.0,       0.0,      1.50,       0.2,          0.7,       0.10,  PRM }",
-   "{       1,       5,         0.0,            5,     0.0,       0.0,      1.40,       0.4,          0.7,       0.10,  PRM }",
-   "{       1,       3,         0.0,            5,     0.0,       0.0,      1.40,       0.2,          0.7,       0.10,  PRM }",
+   "parms active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, clk_factor, pulse_adj, pkww_bitfrac, pkww_rise, pll_bw, id",
+   "{       1,       0,         0.2,            5,     0.0,       0.0,      1.50,       0.4,          0.7,       0.10,  0.000,   PRM }",
+   "{       1,       0,         0.2,            5,     0.0,       0.1,      1.50,       0.4,          0.7,       0.10,  0.000,   PRM }",
+   "{       1,       3,         0.0,            5,     0.0,       0.0,      1.40,       0.0,          0.7,       0.10,  0.000,   PRM }", // works on block 5, but not with pulseadj=0.2
+   "{       1,       3,         0.0,            5,     0.0,       0.0,      1.40,       0.2,          0.7,       0.10,  0.000,   PRM }",
+   "{       1,       5,         0.0,            5,     0.0,       0.0,      1.40,       0.0,          0.7,       0.10,  0.000,   PRM }",
+   "{       1,       5,         0.0,            5,     0.0,       0.0,      1.50,       0.2,          0.7,       0.10,  0.000,   PRM }",
+   "{       1,       5,         0.0,            5,     0.0,       0.0,      1.40,       0.4,          0.7,       0.10,  0.000,   PRM }",
+   "{       1,       3,         0.0,            5,     0.0,       0.0,      1.40,       0.2,          0.7,       0.10,  0.000,   PRM }",
    {0 } };
 
 struct parms_t parmsets_NRZI[MAXPARMSETS] = { 0 }; // where we store the NRZI default parmsets
 char *parmcmds_NRZI[MAXPARMSETS] = { // commands to set defaults for NRZI
-   "parms  active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, pulse_adj, pkww_bitfrac, pkww_rise, midbit,  id",
-   "{        1,       0,      0.200,          0,      0.300,      1.000,      0.300,      0.700,      0.200,      0.500,   PRM }",
-   "{        1,       0,      0.300,          0,      0.300,      1.000,      0.400,      0.600,      0.200,      0.500,   PRM }",
-   "{        1,       2,      0.000,          0,      0.300,      1.000,      0.400,      0.700,      0.200,      0.500,   PRM }",
-   "{        1,       0,      0.600,          0,      0.300,      1.000,      0.400,      0.600,      0.200,      0.500,   PRM }",
-   "{        1,       2,      0.000,          1,      0.000,      0.500,      0.500,      0.900,      0.050,      0.500,   PRM }", // for shallow peaks
-   "{        1,       0,      0.200,          1,      0.000,      1.000,      0.500,      0.700,      0.050,      0.500,   PRM }",
-   "{        1,       2,      0.000,          1,      0.000,      0.500,      0.500,      0.700,      0.050,      0.500,   PRM }",
-   "{        1,       0,      0.600,          1,      0.000,      0.500,      0.500,      0.600,      0.050,      0.500,   PRM }",
+   "parms  active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, pulse_adj, pkww_bitfrac, pkww_rise, midbit, pll_bw, id",
+   "{        1,       0,      0.200,          0,      0.300,      1.000,      0.300,      0.700,      0.200,      0.500,   0.000,   PRM }",
+   "{        1,       0,      0.300,          0,      0.300,      1.000,      0.400,      0.600,      0.200,      0.500,   0.000,   PRM }",
+   "{        1,       2,      0.000,          0,      0.300,      1.000,      0.400,      0.700,      0.200,      0.500,   0.000,   PRM }",
+   "{        1,       0,      0.600,          0,      0.300,      1.000,      0.400,      0.600,      0.200,      0.500,   0.000,   PRM }",
+   "{        1,       2,      0.000,          1,      0.000,      0.500,      0.500,      0.900,      0.050,      0.500,   0.000,   PRM }", // for shallow peaks
+   "{        1,       0,      0.200,          1,      0.000,      1.000,      0.500,      0.700,      0.050,      0.500,   0.000,   PRM }",
+   "{        1,       2,      0.000,          1,      0.000,      0.500,      0.500,      0.700,      0.050,      0.500,   0.000,   PRM }",
+   "{        1,       0,      0.600,          1,      0.000,      0.500,      0.500,      0.600,      0.050,      0.500,   0.000,   PRM }",
    { 0 } };
 
 struct parms_t parmsets_GCR[MAXPARMSETS] = { 0 }; // where we store the GCR default parmsets
 char *parmcmds_GCR[MAXPARMSETS] = { // commands to set defaults for GCR
-   "parms  active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, pulse_adj, pkww_bitfrac, pkww_rise, z1pt, z2pt, id",
-   "{         1,          0,      0.015,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.450,  2.350,   PRM }",
-   "{         1,          0,      0.020,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.450,  2.350,   PRM }",
-   "{         1,          0,      0.010,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.450,  2.350,   PRM }",
-   "{         1,         10,      0.000,       0,      0.500,      0.000,   0.600,      1.500,      0.140,     1.400,  2.300,   PRM }",
-   "{         1           0       0.020,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.480,  2.350,   PRM }",
+   "parms  active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, pulse_adj, pkww_bitfrac, pkww_rise, z1pt, z2pt, pll_bw, id",
+   "{         1,          0,      0.015,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.450,  2.350,   0.000,   PRM }",
+   "{         1,          0,      0.020,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.450,  2.350,   0.000,   PRM }",
+   "{         1,          0,      0.010,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.450,  2.350,   0.000,   PRM }",
+   "{         1,         10,      0.000,       0,      0.500,      0.000,   0.600,      1.500,      0.140,     1.400,  2.300,   0.000,   PRM }",
+   "{         1           0       0.020,       0,      0.500,      0.200,   0.300,      1.500,      0.200,     1.480,  2.350,   0.000,   PRM }",
    { 0 } };
 
 struct parms_t parmsets_WW[MAXPARMSETS] = { 0 }; // where we store the Whirlwind default parmsets
 char *parmcmds_WW[MAXPARMSETS] = { // commands to set defaults for GCR
-   "parms  active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, pkww_bitfrac, pkww_rise, id",
-   "{         1,          0,      0.050,       0,      0.500,      1.000,    0.400,      0.200,    PRM }",
-   "{         1,          0,      0.020,       0,      0.500,      0.050,    0.200,      0.200,    PRM }",
+   "parms  active, clk_window, clk_alpha, agc_window, agc_alpha, min_peak, pkww_bitfrac, pkww_rise, pll_bw, id",
+   "{         1,          0,      0.050,       0,      0.500,      1.000,    0.400,      0.200,    0.000,   PRM }",
+   "{         1,          0,      0.020,       0,      0.500,      0.050,    0.200,      0.200,    0.000,   PRM }",
    { 0 } };
 
 
@@ -192,12 +193,12 @@ goodend:
 
 void show_parms(struct parms_t *psptr, bool showall) {
    rlog("  parms ");
-   for (int i = 0; i < MAXPARMSETS && parms[i].type != P_END; ++i)
+   for (int i = 0; i < MAXPARMS && parms[i].type != P_END; ++i)
       if (showall || parms[i].mode & mode)
          rlog(parms[i].type == P_STR ? "%4s\n" : "%11s,", parms[i].name);
    for (struct parms_t *setptr = psptr; setptr->active == 1; ++setptr) {
       rlog("  {   ");
-      for (int i = 0; i < MAXPARMSETS && parms[i].type != P_END; ++i) {
+      for (int i = 0; i < MAXPARMS && parms[i].type != P_END; ++i) {
          if (showall || parms[i].mode & mode)
             switch (parms[i].type) {
             case P_INT: rlog("%10d, ", *(int *)((char*)setptr + parms[i].offset)); break;
@@ -325,6 +326,11 @@ void parse_parms(struct parms_t *parmarray, char*(*getnextline)(void)) {
                if (setndx == 0 && (parms[ourparmndx].mode & mode))
                   rlog("  --->missing %s integer parm %s; using default of %d for all parmsets\n", modename(), parms[ourparmndx].name, defaultval); } } } };
 
+void override_parms(void) { // apply command-line overrides to all the parmsets
+   if (pll_bw_override >= 0)
+      for (int setndx = 0; setndx < MAXPARMSETS && parmsets[setndx].active == 1; ++setndx)
+         parmsets[setndx].pll_bw = pll_bw_override; }
+
 FILE *parmf;
 char *next_file_line(void) { // get the next line from the .parms file
    return fgets(line, MAXLINE, parmf); }
@@ -366,12 +372,14 @@ void read_parms(void) {   // process the optional .parms file of parameter sets
             // no parameter sets file: use the default set for this type of tape
             setptr = default_parmset();
             memcpy(parmsets, setptr, sizeof(parmsets));
+            override_parms();
             if (!quiet) {
                rlog("\nno .parms file was found, so we're using these internal defaults for the %s parameter sets:\n", modename());
                show_parms(parmsets, false); }
             return; } } }
    if (!quiet) rlog("\nreading parmsets from file %s\n", filename);
    parse_parms(parmsets, next_file_line);
+   override_parms();
    if (!quiet) show_parms(parmsets, false); // show the parms we will be using
 }
 
@@ -324,6 +324,69 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 *** 11 July 2022, L. Shustek, V3.16
  - Fix -tapread: filename parsing; trying to show info not in the .tap file.
 
+*** 18 Oct 2026, V3.17
+- Add -twophase decoding: first decode all blocks with one parmset, then retry only
+  the bad blocks with the other parmsets, limited by -retryblk= and -retrytape=
+  time budgets, then write all the blocks in tape order.
+- Add -follow[=n] to decode an input file that is still being written. At the end of
+  the file we wait for more data, and stop when a .tbin end marker appears or when
+  nothing has been added for n seconds.
+- Add a digital phase-locked loop as an alternative clock recovery strategy for all
+  encodings, selected by the new "pll_bw" parmset parameter or the -pll=b option.
+- Read .tbin files whose samples are stored in planar per-track groups, which
+  csvtbin now creates with -planar.
+- Add -replay[=x] to simulate decoding during a live capture: samples are made
+  available at x times the recorded rate, and we report a histogram of the
+  latency from the end of each block to when we have finished with it.
+- Add -bidir to also decode a bad PE block backwards from its postamble, and splice
+  the forward and backward decodings where they agree after the forward first error.
+- For 9-track NRZI, -correct now also fixes parity errors that are all on one track if
+  that makes both the CRC and the LRC correct.
+- Add -correctfirst, which is -correct but also stops trying other parmsets as soon as
+  GCR ECC or NRZI CRC/LRC correction produces a block without errors.
+- Give each peak a confidence from its height, timing, and AGC gain. With -correct,
+  low-confidence and faked bits are erasure pointers: one per byte fixes PE and NRZI
+  parity errors, and two per GCR data group allow two-track ECC correction.
+- With -correct, GCR data groups corrected by the ECC no longer also count as ECC errors.
+- Add -vote, which builds a composite of a bad block from the bytes that passed their
+  local checks in each parmset's decoding, and uses it if it has fewer errors.
+- Add -fuse to decode several captures of the same tape and merge their .tap files,
+  taking each record from the first capture that got it right, or by voting.
+- Add the tapdiff utility, which compares two .tap files record by record using
+  hashes, and reports records that were changed, deleted, or inserted.
+- Add -manifest, which creates a CSV file with the SHA-256 hash, length, times, errors,
+  and parmset of each record as it is written, and the hash of each output file.
+- Add -redecode=bbb, which copies the records that were perfect in an earlier run's
+  bbb.tap and manifest, and decodes only the others again, starting where they were.
+- Add -sumr to append a CSV line of robustness and speed results, for graphing
+  decodings of the damaged files created by the new csvtbin fault injection options.
+- Check and correct the GCR residual and CRC groups with their ECCs, verify the
+  CRC group's check bytes and the residual byte against the block length, and
+  verify the block CRC. With -correct, use the block CRC to choose the right
+  correction for up to 4 dgroups that the ECC couldn't correct.
+- Add -drift, which fits a model of the tape speed from the good blocks so far and
+  uses it to start the clock and size the peak-detect window of each new block.
+- Add -health, which keeps a running score of each track's health across blocks and
+  nominates a track that keeps going bad to break ties between erasure pointers.
+- Add -equalize, which filters each track with an adaptive equalizer that learns
+  from the peaks of the blocks that decode without errors.
+- Add -baseline, which tracks a slowly drifting DC offset on each track from the
+  midpoint of its recent tops and bottoms, and subtracts it from the samples.
+- Add -peakshift, which learns from the first good blocks how much each track's peaks
+  are shifted by the pattern of the peaks around them, and corrects for it.
+- Add -viterbi, which for GCR decides how many zeroes precede each peak by finding the
+  most likely sequence that makes only valid 5-bit subgroups on each track.
+- If a .tbin file has the chunk checksums that csvtbin now writes with -checksums,
+  check them when the file is opened, report the times of any bad chunks, and mark
+  blocks that were decoded from samples in bad chunks as having errors.
+- Add -deadline=x for live decoding: a block stops trying new parmsets after x
+  seconds and the best decoding so far is written. At the end the block is retried
+  with the rest of the parmsets, and the record is rewritten if that's better.
+- Add -mixed for tapes whose files were written at different densities or with
+  different encodings. After each tapemark the transition spacings of the first
+  block are examined, and if they match a different standard format we switch
+  to its decoder and parmsets. Without -bpi, the starting format is chosen that way.
+
  TODO:
 - support reading Saleae binary export files;
   see https://support.saleae.com/faq/technical-faq/data-export-format-analog-binary
@@ -344,7 +407,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
   global command-line options that can be overridden from the .parm file.
 ***********************************************************************************/
 
-#define VERSION "3.16"
+#define VERSION "3.17"
 
 /*  the default bit and track numbering, where 0=msb and P=parity
              on tape     our tracks   in memory here    exported data
@@ -468,11 +531,16 @@ char baseoutfilename[MAXPATH] = { 0 };
 char outpathname[MAXPATH] = { 0 };
 char summtxtfilename[MAXPATH] = { 0 };
 char summcsvfilename[MAXPATH] = { 0 };
+char summrobfilename[MAXPATH] = { 0 };
+char redecode_basefilename[MAXPATH] = { 0 };
 char outdatafilename[MAXPATH], indatafilename[MAXPATH];
 
 // statistics for the whole tape
 int numblks = 0, numblks_err = 0, numblks_warn = 0, numblks_trksmismatched = 0, numblks_midbiterrs = 0;
-int numblks_goodmultiple = 0, numblks_unusable = 0, numblks_corrected = 0;
+int numblks_goodmultiple = 0, numblks_unusable = 0, numblks_corrected = 0, numblks_bidir = 0, numblks_voted = 0, numblks_mlchanged = 0;
+int numblks_tbindamaged = 0, numblks_cutshort = 0, numblks_patched = 0;
+int num_format_changes = 0;  // for -mixed, how many times the encoding or density changed
+int numblks_copied = 0, numblks_redecoded = 0, numblks_redecode_improved = 0, numblks_redecode_kept = 0, numblks_redecode_lost = 0;
 int numblks_limit = INT_MAX;
 int numfiles = 0, numtapemarks = 0, num_flux_polarity_changes = 0;
 long long lines_in = 0, numdatabytes = 0, numoutbytes = 0;
@@ -489,10 +557,22 @@ int verbose_level = 0, debug_level = 0;
 bool baseoutfilename_given = false;
 bool filelist = false, tap_format = false, tap_read = false;
 bool tbin_file = false, do_txtfile = false, labels = true;
-bool multiple_tries = false, deskew = false, adjdeskew = false, skew_given = false, add_parity = false;
+bool multiple_tries = false, deskew = false, adjdeskew = false, speed_drift = false, track_health = false, equalizing = false, restore_baseline = false, learn_peakshift = false, skew_given = false, add_parity = false;
 bool invert_data = false, autoinvert_data = false, reverse_tape = false;
 bool doing_deskew = false, doing_density_detection = false, doing_summary = false;
-bool do_correction = false, find_zeros = false, do_differentiate = false;
+bool do_correction = false, find_zeros = false, do_differentiate = false, do_viterbi = false;
+bool correct_first = false;  // for -correctfirst, stop retrying when error correction makes the block good
+bool two_phase = false;
+bool bidir = false;  // for -bidir, also decode bad PE blocks backwards
+bool vote = false;   // for -vote, assemble bad blocks from the good bytes of all the parmset decodings
+bool fuse = false;   // for -fuse, the input files are captures of the same tape that are fused into one .tap file
+bool manifest = false;  // for -manifest, write a line with the hash of each record as it is written
+int follow_secs = 0;  // for -follow, how long to wait for the file to grow; 0 means we're not following
+float replay_speed = 0;  // for -replay, how many times faster than real time the data arrives; 0 means we're not replaying
+float retry_block_secs = 0, retry_tape_secs = 0; // time limits for -twophase retries; 0 means none
+float deadline_secs = 0;    // for -deadline, the time limit for trying parmsets on a block; 0 means none
+bool mixed_formats = false;  // for -mixed, the encoding and density may change at tapemarks
+float pll_bw_override = -1;  // for -pll=, the clock PLL bandwidth to use in all parmsets; -1 means use the parmsets' values
 enum flux_direction_t flux_direction_requested = FLUX_NEG, flux_direction_current = FLUX_AUTO;
 bool set_ntrks_from_order = false;
 bool hdr1_label = false;
@@ -510,6 +590,15 @@ char track_order_string[MAXTRKS + 1] = { 0 };
 struct tbin_hdr_t tbin_hdr = { 0 };
 struct tbin_hdrext_trkorder_t tbin_hdrext_trkorder = { 0 };
 struct tbin_dat_t tbin_dat = { 0 };
+int planar_groupsize = 0;     // for planar .tbin files, the samples per track in a group; otherwise 0
+int16_t *planar_raw = NULLP;  // a planar group as read from the file
+int16_t *planar_group = NULLP;// that planar group transposed into interleaved order
+int planar_count = -1;        // how many samples are in planar_group; -1 means it needs to be read
+int planar_ndx = 0;           // the next sample in planar_group to use
+int64_t planar_grouppos;      // the file position of the planar group
+int64_t tbin_datapos;         // the file position of the first .tbin sample
+int64_t *tbin_badchunks = NULLP; // the file positions of .tbin data chunks whose checksums were wrong
+int tbin_numbad = 0;          // how many there are
 
 enum mode_t mode = PE;      // default
 float bpi_specified = -1;   // -1 means not specified; 0 means do auto-detect
@@ -528,6 +617,7 @@ char version_string[] = { VERSION };
 
 int starting_parmset = 0;
 time_t start_time;
+double start_wall_secs;
 double data_start_time = 0;
 double last_block_time = 0;
 double block_start_time = 0;
@@ -726,6 +816,8 @@ void SayUsage (void) {
                             "  -ips=n         speed in inches/sec (default: 50, except 25 for GCR)",
                             "  -bpi=n         density in bits/inch (default: autodetect)",
                             "  -zeros         base decoding on zero crossings instead of peaks",
+                            "  -pll=b         recover the clock with a PLL of loop bandwidth b (0 to 0.5 of the bit rate)",
+                            "  -drift         start each block's clock at the speed predicted from the previous good blocks",
                             "  -differentiate do simple delta differentiation of the input data",
                             "  -even          expect even parity instead of odd (for 7-track NRZI BCD tapes)",
                             "  -revparity=n   reverse parity for blocks up to n bytes long",
@@ -740,8 +832,19 @@ void SayUsage (void) {
                             "  -deskew        do NRZI track deskewing based on the beginning data",
                             "  -skew=n,n      use this skew, in #samples for each track, rather than deducing it",
                             "  -correct       do error correction, where feasible",
+                            "  -correctfirst  do error correction, and don't try other parmsets if that fixes the block",
+                            "  -health        with -correct, prefer the track that has been bad in recent blocks among erasure pointers",
+                            "  -equalize      filter each track with an equalizer trained on the blocks that decode well",
+                            "  -baseline      track and remove a slowly drifting DC offset on each track",
+                            "  -peakshift     correct peak timing by pattern, as learned from the first good blocks",
+                            "  -viterbi       for GCR, choose the most likely zero counts that make valid subgroups",
+                            "  -bidir         also decode bad PE blocks backwards, and splice the two decodings",
+                            "  -vote          combine the good bytes from all parmsets' decodings of a bad block",
+                            "  -fuse          the files are captures of the same tape: decode each, then fuse the .tap files",
                             "  -addparity     include the parity bit as the highest bit in the data (for ntrks<9)",
                             "  -tbin          only look for a .tbin input file, not .csv first",
+                            "  -follow[=n]    follow an input file that is still growing; quit after n idle seconds",
+                            "  -replay[=x]    simulate live capture at x times the recorded rate, and report latencies",
                             "  -nolog         don't create a log file",
                             "  -nolabels      don't try to decode IBM standard tape labels",
                             "  -textfile      create an interpreted .<options>.txt file from the data",
@@ -756,8 +859,16 @@ void SayUsage (void) {
                             "  -outp=ppp      otherwise use ppp as an optional prepended path for output files",
                             "  -sumt=sss      append a text summary of results to text file sss",
                             "  -sumc=ccc      append a CSV summary of results to text file ccc",
+                            "  -sumr=rrr      append a CSV line of robustness and speed results to text file rrr",
+                            "  -manifest      create a CSV file with the SHA-256 hash of each record and output file",
+                            "  -redecode=bbb  copy the perfect records of bbb.tap, and decode only the others again",
                             "  -m             try multiple ways to decode a block",
                             "  -nm            don't try multiple ways to decode a block",
+                            "  -twophase      decode all blocks once, then retry only the bad ones",
+                            "  -retryblk=x    with -twophase, spend at most x seconds retrying a block",
+                            "  -retrytape=x   with -twophase, spend at most x seconds retrying all blocks",
+                            "  -deadline=x    spend at most x seconds on a block, and finish it at the end",
+                            "  -mixed         the encoding and density may change at tapemarks; detect and follow it",
                             "  -v[n]          verbose mode [level n, default is 1]",
 #if DEBUG
                             "  -d[n]          debug options [bits in n, default is 1]",
@@ -929,14 +1040,22 @@ bool parse_option(char *option) { // (also called from .parm file processor)
    else if (opt_str(arg, "SKEW=", &str)
             && parse_skew(str)) deskew = skew_given = true;
 #endif
+   else if (opt_key(arg, "DRIFT")) speed_drift = true;
+   else if (opt_key(arg, "HEALTH")) track_health = true;
+   else if (opt_key(arg, "EQUALIZE")) equalizing = true;
+   else if (opt_key(arg, "BASELINE")) restore_baseline = true;
+   else if (opt_key(arg, "PEAKSHIFT")) learn_peakshift = true;
+   else if (opt_key(arg, "VITERBI")) do_viterbi = true;
    else if (opt_key(arg, "ADDPARITY")) add_parity = true;
    else if (opt_key(arg, "CORRECT")) do_correction = true;
    else if (opt_key(arg, "NOCORRECT")) do_correction = false;
+   else if (opt_key(arg, "CORRECTFIRST")) do_correction = correct_first = true;
    else if (opt_key(arg, "TBIN")) tbin_file = true;
    else if (opt_filename(arg, "OUTF=", baseoutfilename)) baseoutfilename_given = true;
    else if (opt_filename(arg, "OUTP=", outpathname));
    else if (opt_filename(arg, "SUMT=", summtxtfilename));
    else if (opt_filename(arg, "SUMC=", summcsvfilename));
+   else if (opt_filename(arg, "SUMR=", summrobfilename));
    else if (opt_key(arg, "TEXTFILE")) do_txtfile = true;
    else if (opt_key(arg, "HEX")) txtfile_numtype = HEX;
    else if (opt_key(arg, "OCTAL2")) {
@@ -960,6 +1079,21 @@ bool parse_option(char *option) { // (also called from .parm file processor)
    else if (opt_key(arg, "NOLOG")) logging = false;
    else if (opt_key(arg, "NOLABELS")) labels = false;
    else if (opt_key(arg, "NM")) multiple_tries = false;
+   else if (opt_key(arg, "TWOPHASE")) two_phase = multiple_tries = true;
+   else if (opt_key(arg, "BIDIR")) bidir = true;
+   else if (opt_key(arg, "VOTE")) vote = true;
+   else if (opt_key(arg, "FUSE")) fuse = tap_format = true;
+   else if (opt_key(arg, "MANIFEST")) manifest = true;
+   else if (opt_filename(arg, "REDECODE=", redecode_basefilename)) manifest = tap_format = true;
+   else if (opt_key(arg, "FOLLOW")) follow_secs = FOLLOW_DEFAULT_SECS;
+   else if (opt_int(arg, "FOLLOW=", &follow_secs, 1, INT_MAX));
+   else if (opt_key(arg, "REPLAY")) replay_speed = 1;
+   else if (opt_flt(arg, "REPLAY=", &replay_speed, 0.01f, 1000));
+   else if (opt_flt(arg, "RETRYBLK=", &retry_block_secs, 0, 1e6));
+   else if (opt_flt(arg, "RETRYTAPE=", &retry_tape_secs, 0, 1e9));
+   else if (opt_flt(arg, "DEADLINE=", &deadline_secs, 0, 1e6));
+   else if (opt_key(arg, "MIXED")) mixed_formats = true;
+   else if (opt_flt(arg, "PLL=", &pll_bw_override, 0, 0.5));
    else if (option[2] == '\0') // single-character switches
       switch (toupper(option[1])) {
       case 'H':
@@ -977,6 +1111,19 @@ bool parse_option(char *option) { // (also called from .parm file processor)
 opterror:  fatal("bad option: %s\n\n", option); }
    return true; }
 
+void split_filename(const char *arg, char *filename, char *ext) {
+   // break a commandline filename into name and extension, if one we recognize was given
+   strlcpy(filename, arg, MAXPATH);
+   char *filename_end = strrchr(filename, '.'); // last .
+   if (filename_end &&
+         (strcasecmp(filename_end, ".tap") == 0
+          || strcasecmp(filename_end, ".csv") == 0
+          || strcasecmp(filename_end, ".tbin") == 0)) {
+      strlcpy(ext, filename_end, 15); // copy the extension, with the dot
+      dlog("extension: %s\n", ext);
+      *filename_end = 0; } // and remove it from the filename
+   else ext[0] = 0; } // no extension was given
+
 int HandleOptions (int argc, char *argv[]) {
    /* returns the index of the first argument that is not an option;
    i.e. does not start with a dash */
@@ -1034,12 +1181,14 @@ void output_tap_marker(uint32_t num) {  //output a 4-byte .TAP file marker, litt
    for (int i = 0; i < 4; ++i) {
       byte lsb = num & 0xff;
       assert(fwrite(&lsb, 1, 1, outf) == 1, "fwrite failed in output_tap_marker");
+      if (manifest) manifest_data(&lsb, 1);
       num >>= 8; }
    numoutbytes += 4; }
 
 void close_file(void) {
    if (outf) {
       fclose(outf);
+      if (manifest) manifest_end_file(outdatafilename);
       if (!quiet) rlog("%s was closed at time %.8lf after %s data bytes were extracted from %d blocks\n",
                           outdatafilename, timenow, longlongcommas(numfilebytes), numfileblks);
       outf = NULLP; } }
@@ -1058,6 +1207,7 @@ void create_datafile(const char *name) {
    if (!quiet) rlog("creating file \"%s\"\n", outdatafilename);
    outf = fopen(outdatafilename, "wb");
    assert(outf != NULLP, "file create failed for \"%s\"", outdatafilename);
+   if (manifest) manifest_start_file();
    ++numfiles;
    numfilebytes = numfileblks = 0;
    if (data_start_time == 0) data_start_time = timenow; }
@@ -1065,19 +1215,20 @@ void create_datafile(const char *name) {
 char *modename(void) {
    return mode == PE ? "PE" : mode == NRZI ? "NRZI" : mode == GCR ? "GCR" : mode == WW ? "Whirlwind" : "???"; }
 
-struct file_position_t {   // routines to save and restore the file position, sample time, and number of samples
-   int64_t position;
-   double time;
-   int64_t time_ns;
-   uint64_t nsamples; };
-
 #if defined(_WIN32) // there is NO WAY to do this in an OS-independent fashion!
 #define ftello _ftelli64
 #define fseeko _fseeki64
+__declspec(dllimport) void __stdcall Sleep(unsigned long msec); // (rather than including all of windows.h)
+#define sleep_msec(n) Sleep(n)
+#else
+#include <unistd.h>
+#define sleep_msec(n) usleep((n)*1000)
 #endif
 
 void save_file_position(struct file_position_t *fp, const char *msg) {
-   assert((fp->position=ftello(inf)) >= 0, "ftell failed");
+   // For planar .tbin files, the position is where the sample would be if the file were interleaved.
+   if (planar_groupsize) fp->position = planar_grouppos + (int64_t)planar_ndx * nheads * 2;
+   else assert((fp->position=ftello(inf)) >= 0, "ftell failed");
    //rlog("        at %.8lf, saving position %s %s\n", timenow, longlongcommas(fp->position), msg);
    //rlog("    save_file_position %s at %.3lf msec\n", msg, timenow*1e3);
    fp->time_ns = timenow_ns;
@@ -1086,12 +1237,158 @@ void save_file_position(struct file_position_t *fp, const char *msg) {
 
 void restore_file_position(struct file_position_t *fp, const char *msg) {
    //rlog("        at %.8lf, restor position %s time %.8lf %s\n", timenow, longlongcommas(fp->position), fp->time, msg);
-   assert(fseeko(inf, fp->position, SEEK_SET) == 0, "fseek failed");
+   if (planar_groupsize) { // find the group with that sample; we'll reread it if it isn't the one we have
+      int64_t groupbytes = (int64_t)planar_groupsize * nheads * 2;
+      int64_t grouppos = tbin_datapos + (fp->position - tbin_datapos) / groupbytes * groupbytes;
+      if (grouppos != planar_grouppos) {
+         planar_grouppos = grouppos;
+         planar_count = -1; }
+      planar_ndx = (int)((fp->position - grouppos) / (nheads * 2)); }
+   else assert(fseeko(inf, fp->position, SEEK_SET) == 0, "fseek failed");
    timenow_ns = fp->time_ns;
    timenow = fp->time;
    numsamples = fp->nsamples; }
 
+void tbin_check_chunks(void) { // check the chunk checksums that follow the .tbin data, and remember the bad chunks
+   tbin_numbad = 0;
+   if (follow_secs) { // the checksums aren't written until the file is complete
+      if (!quiet) rlog("  the .tbin checksums won't be checked because of -follow\n");
+      return; }
+   assert(tbin_dat.checksum_log2 >= TBIN_CHECKSUM_MINLOG2 && tbin_dat.checksum_log2 <= TBIN_CHECKSUM_MAXLOG2,
+          "the .tbin checksum chunk size of 2^%d bytes is invalid", tbin_dat.checksum_log2);
+   byte trailer[sizeof(struct tbin_chk_t)]; // (read byte by byte because it's little-endian)
+   assert(fseeko(inf, -(int64_t)sizeof(trailer), SEEK_END) == 0, "fseek failed");
+   int64_t trailerpos = ftello(inf);
+   if (fread(trailer, sizeof(trailer), 1, inf) != 1 || strcmp((char *)trailer + 12, CHK_TAG) != 0) {
+      rlog("*** WARNING *** the .tbin checksums are missing; the file might be truncated\n");
+      assert(fseeko(inf, tbin_datapos, SEEK_SET) == 0, "fseek failed");
+      return; }
+   uint64_t datasize = 0;
+   uint32_t nchunks = 0;
+   for (int i = 7; i >= 0; --i) datasize = (datasize << 8) | trailer[i];
+   for (int i = 11; i >= 8; --i) nchunks = (nchunks << 8) | trailer[i];
+   size_t chunksize = (size_t)1 << tbin_dat.checksum_log2;
+   assert(nchunks == (datasize + chunksize - 1) / chunksize
+          && tbin_datapos + (int64_t)datasize + 4 * (int64_t)nchunks == trailerpos,
+          "the .tbin checksum trailer doesn't agree with the size of the file");
+   byte *chunk = malloc(chunksize);
+   byte *table = malloc((size_t)nchunks * 4 + 1);
+   tbin_badchunks = realloc(tbin_badchunks, ((size_t)nchunks + 1) * sizeof(int64_t));
+   assert(chunk && table && tbin_badchunks, "can't allocate .tbin checksum buffers");
+   assert(fseeko(inf, tbin_datapos + (int64_t)datasize, SEEK_SET) == 0, "fseek failed");
+   assert(fread(table, 4, nchunks, inf) == nchunks, "can't read the .tbin checksum table");
+   assert(fseeko(inf, tbin_datapos, SEEK_SET) == 0, "fseek failed");
+   for (uint32_t i = 0; i < nchunks; ++i) {
+      size_t len = i < nchunks - 1 ? chunksize : (size_t)(datasize - (uint64_t)i * chunksize);
+      uint32_t crc = table[4 * i] | table[4 * i + 1] << 8 | table[4 * i + 2] << 16 | (uint32_t)table[4 * i + 3] << 24;
+      if (fread(chunk, 1, len, inf) != len || crc_update(0, chunk, len) != crc) {
+         int64_t pos = tbin_datapos + (int64_t)i * chunksize;
+         tbin_badchunks[tbin_numbad++] = pos;
+         rlog("*** WARNING *** .tbin data chunk %d is bad, from about time %.6lf to %.6lf\n", i,
+              (double)(tbin_dat.tstart + (uint64_t)(pos - tbin_datapos) / (tbin_hdr.u.s.ntrks * 2) * sample_deltat_ns) / 1e9,
+              (double)(tbin_dat.tstart + ((uint64_t)(pos - tbin_datapos) + len) / (tbin_hdr.u.s.ntrks * 2) * sample_deltat_ns) / 1e9); } }
+   if (!quiet) rlog("  checked %d .tbin data chunks of %d bytes, and %d %s bad\n",
+                       nchunks, (int)chunksize, tbin_numbad, tbin_numbad == 1 ? "was" : "were");
+   free(chunk);
+   free(table);
+   assert(fseeko(inf, tbin_datapos, SEEK_SET) == 0, "fseek failed"); }
+
+bool tbin_damaged(int64_t from) { // did samples from "from" to here come from a bad .tbin chunk?
+   struct file_position_t here;
+   save_file_position(&here, "for the .tbin checksum check");
+   int64_t to = here.position;
+   if (planar_groupsize) { // the samples came from whole planar groups
+      int64_t groupbytes = (int64_t)planar_groupsize * nheads * 2;
+      from = tbin_datapos + (from - tbin_datapos) / groupbytes * groupbytes;
+      to = tbin_datapos + (to - tbin_datapos + groupbytes - 1) / groupbytes * groupbytes; }
+   int64_t chunksize = (int64_t)1 << tbin_dat.checksum_log2;
+   for (int i = 0; i < tbin_numbad; ++i)
+      if (tbin_badchunks[i] < to && tbin_badchunks[i] + chunksize > from) return true;
+   return false; }
+
+void tbin_mark_damaged(struct results_t *result) { // count a decoding from bad .tbin data as an error, however clean it is
+   if (!result->tbin_damaged) {
+      result->tbin_damaged = 1;
+      ++result->errcount; } }
+
 static struct file_position_t blockstart;
+static bool redecode_copying = false; // is got_datablock() writing a record copied from an earlier run?
+static bool spool_writing = false;    // or a decoding from the -twophase spool file?
+int64_t record_outpos = -1;   // where got_datablock() wrote the last record in the output file, for -deadline; -1 if it didn't
+bool record_damaged = false;  // and whether it was decoded from bad .tbin data
+
+byte *record_bytes(int length) { // discard the parity bit track from the decoded data, unless we're adding it at the top
+   static byte outbuf[MAXBLOCK + 1];
+   for (int i = 0; i < length; ++i) {
+      byte b = (byte)(data[i] >> 1);
+      if (add_parity) b |= (data[i] & 1) << (ntrks-1);  // optionally include parity bit as the highest bit
+      outbuf[i] = b; }
+   return outbuf; }
+
+// For -replay, we pretend that the samples are arriving in real time (or x times faster) from the tape drive, and
+// measure how long after the last sample of each block has arrived that we finish with the block. We wait, if we need to,
+// for samples to "arrive", and on retries we reread samples that have already arrived.
+
+double replay_wall0 = 0;      // the wall clock time when the first sample arrived, in seconds
+double replay_t0;             // the time of the first sample on the tape
+double replay_arrived;        // the tape time up to which samples have arrived
+static const float replay_hist_limits[REPLAY_HIST_BINS - 1] = { // upper limits of the histogram bins, in msec
+   1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000 };
+int replay_hist[REPLAY_HIST_BINS];
+int replay_count = 0;
+double replay_sum_msec, replay_max_msec, replay_max_time;
+float replay_latency_msec;   // the latency of the most recent block or tapemark
+
+double wall_secs(void) { // the wall clock time, in seconds, with better than millisecond resolution
+   struct timespec ts;
+   timespec_get(&ts, TIME_UTC);
+   return (double)ts.tv_sec + ts.tv_nsec / 1e9; }
+
+void replay_reset(void) {
+   replay_wall0 = replay_arrived = 0;
+   replay_count = 0;
+   replay_sum_msec = replay_max_msec = 0;
+   memset(replay_hist, 0, sizeof(replay_hist)); }
+
+void replay_wait(void) { // wait until the sample at "timenow" has arrived
+   if (replay_wall0 == 0) { // this is the first sample
+      replay_wall0 = wall_secs();
+      replay_t0 = replay_arrived = timenow;
+      return; }
+   while (1) {
+      replay_arrived = replay_t0 + (wall_secs() - replay_wall0) * replay_speed;
+      if (replay_arrived >= timenow) return;
+      int msec = (int)((timenow - replay_arrived) / replay_speed * 1000);
+      sleep_msec(max(msec, 1)); } }
+
+void replay_record(void) { // record the latency of a block or tapemark that ended at "timenow"
+   if (replay_wall0 == 0) return;
+   double arrival = replay_wall0 + (timenow - replay_t0) / replay_speed;
+   double msec = (wall_secs() - arrival) * 1000;
+   if (msec < 0) msec = 0;
+   replay_latency_msec = (float)msec;
+   int bin = 0;
+   while (bin < REPLAY_HIST_BINS - 1 && msec >= replay_hist_limits[bin]) ++bin;
+   ++replay_hist[bin];
+   ++replay_count;
+   replay_sum_msec += msec;
+   if (msec > replay_max_msec) {
+      replay_max_msec = msec;
+      replay_max_time = timenow; } }
+
+void show_replay_latencies(void) {
+   int maxcount = 0;
+   for (int bin = 0; bin < REPLAY_HIST_BINS; ++bin) maxcount = max(maxcount, replay_hist[bin]);
+   rlog("  replaying at %.2fx the recorded rate, the latency for %d blocks and tapemarks averaged %.1f msec\n",
+        replay_speed, replay_count, replay_count ? replay_sum_msec / replay_count : 0);
+   if (replay_count == 0) return;
+   rlog("  the maximum latency was %.1f msec for the block ending at time %.8lf\n", replay_max_msec, replay_max_time);
+   for (int bin = 0; bin < REPLAY_HIST_BINS; ++bin)
+      if (replay_hist[bin] > 0) {
+         if (bin < REPLAY_HIST_BINS - 1) rlog("    under %6.0f msec: %6d ", replay_hist_limits[bin], replay_hist[bin]);
+         else rlog("    %6.0f msec or more: %6d ", replay_hist_limits[bin - 1], replay_hist[bin]);
+         for (int i = 0; i < (replay_hist[bin] * 50 + maxcount - 1) / maxcount; ++i) rlog("*");
+         rlog("\n"); } }
 
 /***********************************************************************************************
       end of block processing
@@ -1110,7 +1407,9 @@ void show_ibg_time(void) {
       if (do_txtfile) txtfile_message(msg); } }
 
 void got_tapemark(void) {
+   struct file_position_t tapemark_start = blockstart; // (for the manifest)
    ++numtapemarks;
+   if (replay_speed > 0) replay_record();
    if (show_ibg) show_ibg_time();
    save_file_position(&blockstart, "after tapemark");
    //if (!quiet) rlog("  tapemark after block %d at file position %s time %.8lf\n", numfileblks, longlongcommas(blockstart.position), timenow);
@@ -1119,12 +1418,16 @@ void got_tapemark(void) {
       rlog("  tapemark at time %.8lf", timenow);
       if (SHOW_TAP_OFFSET) rlog(", tap offset %lld", numoutbytes);
       if (SHOW_NUMSAMPLES) rlog(", %lld samples", numsamples);
-      rlog(", %d blocks written so far\n", numblks); }
+      rlog(", %d blocks written so far", numblks);
+      if (replay_speed > 0) rlog(", latency %.1f msec", replay_latency_msec);
+      rlog("\n"); }
    if (do_txtfile) txtfile_tapemark(false);
    if (tap_format) {
       if (!outf) create_datafile(NULLP);
+      if (fuse) fuse_add_record(true, 0, 0, 0, -1);
       output_tap_marker(0x00000000); }
    else if (!hdr1_label) close_file(); // not tap format: close the file if we didn't see tape labels
+   if (manifest) manifest_record(true, NULLP, 0, block.t_blockstart, timenow, 0, 0, 0, &tapemark_start);
    hdr1_label = false; }
 
 // format the errors and warnings that occurred in this block
@@ -1141,7 +1444,8 @@ char * format_block_errors(struct results_t *result) {
       if (result->lrc_errs) bufptr += sprintf(bufptr, ", 1 LRC");
       if (result->ecc_errs) bufptr += sprintf(bufptr, ", %d ECC", result->ecc_errs);
       if (result->ww_bad_length) bufptr += sprintf(bufptr, ", bad length");
-      if (result->ww_speed_err) bufptr += sprintf(bufptr, ", bad speed"); }
+      if (result->ww_speed_err) bufptr += sprintf(bufptr, ", bad speed");
+      if (result->tbin_damaged) bufptr += sprintf(bufptr, ", bad .tbin data"); }
    else bufptr += sprintf(bufptr, "ok");
    if (result->warncount > 0) {
       bufptr += sprintf(bufptr, ", %d warning%s", result->warncount, result->warncount > 1 ? "s" : "");
@@ -1158,11 +1462,14 @@ char * format_block_errors(struct results_t *result) {
       if (result->ww_leading_clock) bufptr += sprintf(bufptr, ", leading clk");
       if (result->ww_missing_onebit) bufptr += sprintf(bufptr, ", missing 1-bit");
       if (result->ww_missing_clock) bufptr += sprintf(bufptr, ", missing clk"); }
+   if (result->gcr_ml_changes) bufptr += sprintf(bufptr, ", %d zero count%s changed", result->gcr_ml_changes, result->gcr_ml_changes > 1 ? "s" : "");
    return buf; }
 
 void got_datablock(bool badblock) { // decoded a tape block
    struct results_t *result = &block.results[block.parmset];
    int length = result->minbits;
+   record_outpos = -1;
+   if (replay_speed > 0) replay_record();
    if (show_ibg) show_ibg_time();
    bool labeled = !badblock && labels && ibm_label(); // process and absorb IBM tape labels
    if (length > 0 && (tap_format || !labeled)) {
@@ -1175,22 +1482,33 @@ void got_datablock(bool badblock) { // decoded a tape block
             rlog("ERROR: unusable block, ");
             if (result->track_mismatch) rlog("tracks mismatched with lengths %d to %d", result->minbits, result->maxbits);
             else rlog("unknown reason");
-            rlog(", %d tries, parmset %d, at time %.8lf\n", block.tries, block.parmset, timenow); } }
+            rlog(", %d tries, parmset %d, at time %.8lf\n", block.tries, block.parmset, timenow); }
+         if (fuse) fuse_add_record(false, length, result->errcount, result->warncount, -1);
+         if (manifest) // (so that -redecode will try it again)
+            manifest_unusable(block.t_blockstart, timenow, result->errcount, result->warncount, block.parmset, &blockstart); }
       else { // We have decoded a block whose data we want to write
          last_block_time = timenow;
          if (!outf) { // create a generic data file if we didn't see a file header label
             create_datafile(NULLP); }
+         bool damaged = tbin_numbad > 0 && !redecode_copying && tbin_damaged(blockstart.position); // from bad .tbin data?
+         if (damaged) tbin_mark_damaged(result); // (so it isn't taken as perfect by -redecode or -fuse)
          uint32_t errflag = result->errcount ? 0x80000000 : 0;  // SIMH .tap file format error flag
+         if (fuse) fuse_add_record(false, length, result->errcount, result->warncount, ftello(outf));
+         if (deadline_secs > 0) { // remember where the record is, in case it gets rewritten
+            assert((record_outpos = ftello(outf)) >= 0, "ftell failed");
+            record_damaged = damaged; }
          if (tap_format) output_tap_marker(length | errflag); // leading record length
-         for (int i = 0; i < length; ++i) { // discard the parity bit track and write all the data bits
-            byte b = (byte)(data[i] >> 1);
-            if (add_parity) b |= (data[i] & 1) << (ntrks-1);  // optionally include parity bit as the highest bit
-            // maybe accumulate batches of data so we call fwrite() less often?
-            assert(fwrite(&b, 1, 1, outf) == 1, "data write failed"); }
+         byte *outbuf = record_bytes(length); // discard the parity bit track and write all the data bits
+         assert(fwrite(outbuf, 1, length, outf) == length, "data write failed");
+         if (manifest) {
+            manifest_data(outbuf, length);
+            manifest_record(false, outbuf, length, block.t_blockstart, timenow,
+                            result->errcount, result->warncount, block.parmset, &blockstart); }
          if (tap_format) {
             byte zero = 0;  // tap format needs an even number of data bytes
             if (length & 1) {
                assert(fwrite(&zero, 1, 1, outf) == 1, "write of odd byte failed");
+               if (manifest) manifest_data(&zero, 1);
                numoutbytes += 1; }
             output_tap_marker(length | errflag); // trailing record length
          }
@@ -1241,6 +1559,7 @@ void got_datablock(bool badblock) { // decoded a tape block
             if (SHOW_START_TIME) rlog(", start %.8lf", block.t_blockstart);
             if (SHOW_TAP_OFFSET) rlog(", tap offset %lld", numoutbytes);
             if (SHOW_NUMSAMPLES) rlog(", %lld samples", numsamples);
+            if (replay_speed > 0) rlog(", latency %.1f msec", replay_latency_msec);
             rlog("\n");
 
             if (!verbose && numblks == 0) rlog("(subsequent good blocks will not be shown because -v wasn't specified)\n"); }
@@ -1253,12 +1572,18 @@ void got_datablock(bool badblock) { // decoded a tape block
                  result->missed_midbits, block.parmset, numblks + 1, timenow); //
          }
          if (result->corrected_bits > 0) ++numblks_corrected;
+         if (result->gcr_ml_changes > 0) ++numblks_mlchanged;
+         if (damaged) {
+            ++numblks_tbindamaged;
+            rlog("   WARNING: block %d at %.8lf was decoded from samples in a bad .tbin data chunk\n", numblks + 1, timenow); }
          numfilebytes += length;
          numoutbytes += length;
          numdatabytes += length;
          ++numfileblks;
          ++numblks; } }
-   if (adjdeskew && mode == NRZI) adjust_deskew(nrzi.clkavg.t_bitspaceavg);
+   if (!spool_writing) { // (-twophase did these when it decoded the block)
+      if (adjdeskew && mode == NRZI) adjust_deskew(nrzi.clkavg.t_bitspaceavg);
+      models_block_done(length, !badblock && result->errcount == 0); }
    save_file_position(&blockstart, "after block done"); // remember the file position for the start of the next block
 //log("got valid block %d, file pos %s at %.8lf\n", numblks, longlongcommas(blockstart.position), timenow);
 };
@@ -1323,6 +1648,20 @@ void read_tbin_header(void) {  // read the .TBIN file header
    assert(strcmp(tbin_dat.tag, DAT_TAG) == 0, ".tbin file missing DAT tag");
    assert(tbin_dat.sample_bits == 16, "we support only 16 bits/sample, not %d", tbin_dat.sample_bits);
    if (!little_endian) reverse8(&tbin_dat.tstart); // convert to big endian if necessary
+   assert((tbin_datapos = ftello(inf)) >= 0, "ftell failed");
+   if (tbin_dat.options & TDATOPT_planar) {
+      assert(tbin_dat.planar_log2 <= TBIN_PLANAR_MAXLOG2, "the .tbin planar group size of 2^%d is too big", tbin_dat.planar_log2);
+      planar_groupsize = 1 << tbin_dat.planar_log2;
+      if (!planar_group) {
+         planar_raw = malloc(((size_t)1 << TBIN_PLANAR_MAXLOG2) * MAXTRKS * 2 + 2);
+         planar_group = malloc(((size_t)1 << TBIN_PLANAR_MAXLOG2) * MAXTRKS * 2);
+         assert(planar_raw && planar_group, "can't allocate planar .tbin buffers"); }
+      planar_grouppos = tbin_datapos;
+      planar_count = -1;
+      planar_ndx = 0;
+      if (!quiet) rlog("  the samples are in planar groups of %d per track\n", planar_groupsize); }
+   tbin_numbad = 0;
+   if (tbin_dat.options & TDATOPT_checksums) tbin_check_chunks();
    timenow_ns = tbin_dat.tstart;
    timenow = (float)timenow_ns / 1e9; };
 
@@ -1344,6 +1683,133 @@ void differentiate(struct sample_t *psample, int trk) { // do simple-minded diff
          rlog("derivative, %.8f, %.4f, %.4f\n", timenow, voltage, psample->voltage[trk]);
          ++derivative_dumps; } } }
 
+bool follow_more_data(int64_t position, size_t bytes_read) {
+   // For -follow, wait for the input file to grow, and leave it positioned at "position" to reread.
+   // The failed read there returned "bytes_read" bytes of a partial sample or line, so that is where the file ended
+   // then; it may already have grown since, which counts. Return false if it hasn't grown for follow_secs seconds.
+   if (outf) fflush(outf);  // make what we've done so far visible
+   if (rlogf) fflush(rlogf);
+   int64_t oldsize = position + (int64_t)bytes_read;
+   time_t wait_start = time(NULL);
+   do {
+      sleep_msec(FOLLOW_POLL_MSEC);
+      clearerr(inf);
+      assert(fseeko(inf, 0, SEEK_END) == 0, "fseek failed");
+      int64_t size = ftello(inf);
+      assert(fseeko(inf, position, SEEK_SET) == 0, "fseek failed");
+      if (size > oldsize) return true; }
+   while (difftime(time(NULL), wait_start) < follow_secs);
+   if (!quiet) rlog("the input file hasn't grown for %d seconds at time %.8lf\n", follow_secs, timenow);
+   return false; }
+
+bool read_planar_group(void) { // read and transpose a planar .tbin group; return false at the end of the data
+   size_t groupvals = (size_t)planar_groupsize * nheads;
+   while (1) {
+      assert(fseeko(inf, planar_grouppos, SEEK_SET) == 0, "fseek failed");
+      size_t nread = fread(planar_raw, 2, groupvals, inf);
+      if (!little_endian)
+         for (size_t i = 0; i < nread; ++i) reverse2((uint16_t *)&planar_raw[i]);
+      int count = 0; // how many samples are in this group, which might be the last one
+      while (count < planar_groupsize && count < nread && planar_raw[count] != -32768 /*0x8000*/) ++count;
+      int last = count < planar_groupsize; // the last group has the end marker after track 0
+      if ((!last || count < nread) && nread >= (size_t)count * nheads + last) { // we have the whole group
+         for (int head = 0; head < nheads; ++head) {
+            int16_t *plane = planar_raw + (head == 0 ? 0 : head * count + last);
+            for (int i = 0; i < count; ++i) planar_group[i * nheads + head] = plane[i]; }
+         planar_count = count;
+         return count > 0; }
+      if (!follow_secs) fatal("can't read the .tbin planar data group at time %.8lf", timenow);
+      if (!follow_more_data(planar_grouppos, nread * 2)) return false; } } // wait for the rest of the group
+
+bool read_tbin_sample(int16_t *tbin_voltages) { // read the voltages for all heads; return false at the end of the data
+   if (planar_groupsize) { // the samples come from a transposed planar group
+      if (planar_count >= 0 && planar_ndx >= planar_count) { // we're done with this group
+         if (planar_count < planar_groupsize) return false; // that was the last group
+         planar_grouppos += (int64_t)planar_groupsize * nheads * 2;
+         planar_ndx = 0;
+         planar_count = -1; }
+      if (planar_count < 0 && !read_planar_group()) return false;
+      if (planar_ndx >= planar_count) return false;
+      memcpy(tbin_voltages, &planar_group[planar_ndx++ * nheads], nheads * 2);
+      return true; }
+   while (1) {
+      int64_t position = follow_secs ? ftello(inf) : 0;
+      size_t nread = fread(tbin_voltages, 2, nheads, inf);
+      if (nread > 0) {
+         if (!little_endian) reverse2((uint16_t *)&tbin_voltages[0]);
+         if (tbin_voltages[0] == -32768 /*0x8000*/) return false; // end of file marker
+         if (nread == nheads) {
+            if (!little_endian)
+               for (int head = 1; head < nheads; ++head)
+                  reverse2((uint16_t *)&tbin_voltages[head]);
+            return true; } }
+      if (!follow_secs) {
+         assert(nread > 0, "can't read .tbin data for head 0 at time %.8lf", timenow);
+         fatal("can't read .tbin data for heads 1.. at time %.8lf", timenow); }
+      if (!follow_more_data(position, nread * 2)) return false; } } // wait for the rest of the sample
+
+bool read_csv_line(char *line) { // read the next CSV line; return false at the end of the data
+   while (1) {
+      int64_t position = follow_secs ? ftello(inf) : 0;
+      if (fgets(line, MAXLINE, inf)
+            && (!follow_secs || strchr(line, '\n'))) return true; // (when following, the line must be complete)
+      if (!follow_secs || !follow_more_data(position, (size_t)(ftello(inf) - position))) return false; } } // (text mode may drop CRs)
+
+// For -bidir, a PE block that has errors is also decoded backwards in time, starting from its postamble, using the samples
+// of the forward decoding that we buffer. A localized dropout usually ruins everything after it in the forward decoding
+// because the clock and AGC averagers go astray, but the backward decoding reaches it last. So we splice the beginning of
+// the forward decoding to the end of the backward decoding at a place where they agree.
+// Reversing time turns a PE postamble into a preamble, and the peaks for each bit keep their polarity if we use the
+// polarity we found going forwards. NRZI and GCR blocks aren't symmetric that way, so we don't do this for them.
+
+struct sample_t *bidir_samples = NULLP; // the buffered samples of the block, before differentiation
+int bidir_numalloc = 0;                 // how many samples there is room for
+int bidir_ndx;                          // the number of samples that haven't been used yet by the backward decoding
+bool bidir_backward = false;            // are we now decoding backwards?
+bool bidir_bit1_up[MAXTRKS];            // the PE bit polarity of each track in the forward decoding
+double bidir_tmirror;                   // the time that sample times are reflected around when going backwards
+
+bool read_sample(struct sample_t *sample) { // get the next sample, not yet differentiated
+   // return false if we are at the endfile
+   if (bidir_backward) { // take them from the buffer in reverse order, reflecting the time
+      if (bidir_ndx <= 0) return false;
+      *sample = bidir_samples[--bidir_ndx];
+      sample->time = 2 * bidir_tmirror - sample->time;
+      if (do_differentiate) // (so that after differentiation the peaks have the same polarity as going forward)
+         for (int trk = 0; trk < ntrks; ++trk) sample->voltage[trk] = -sample->voltage[trk];
+      return true; }
+   if (tbin_file) { // TBIN file
+      int16_t tbin_voltages[MAXTRKS];
+      for (int i = 0; i < subsample; ++i) // read the subsample=nth line and ignore all the others
+         if (!read_tbin_sample(tbin_voltages)) return false; // end of file marker
+      for (int head = 0; head < nheads; ++head) {
+         int trk = head_to_trk[head];
+         sample->voltage[trk] = (float)tbin_voltages[head] / 32767 * tbin_hdr.u.s.maxvolts;
+         if (invert_data) sample->voltage[trk] = -sample->voltage[trk]; }
+      sample->time = (double)timenow_ns / 1e9;
+      timenow_ns += sample_deltat_ns; // (for next time)
+   }
+   else {  // CSV file
+      char line[MAXLINE + 1];
+      for (int i=0; i < subsample; ++i) // read the subsample=nth line and ignore all the others
+         if (!read_csv_line(line)) return false;
+      line[MAXLINE - 1] = 0;
+      /* sscanf is excruciately slow and was taking 90% of the processing time!
+      The special-purpose scan routines are about 25 times faster, but do
+      no error checking. We replaced the following code:
+      items = sscanf(line, " %lf, %f, %f, %f, %f, %f, %f, %f, %f, %f ", &sample.time,
+      &sample.voltage[0], &sample.voltage[1], &sample.voltage[2],
+      &sample.voltage[3], &sample.voltage[4], &sample.voltage[5],
+      &sample.voltage[6], &sample.voltage[7], &sample.voltage[8]);
+      assert (items == ntrks+1,"bad CSV line format"); */
+      char *linep = line;
+      sample->time = scanfast_double(&linep);  // get the time of this sample
+      for (int head = 0; head < nheads; ++head) { // read voltages for all tracks, and permute as requested
+         int trk = head_to_trk[head];
+         sample->voltage[trk] = scanfast_float(&linep);
+         if (invert_data) sample->voltage[trk] = -sample->voltage[trk]; } }
+   return true; }
+
 bool readblock(bool retry) { // read the CSV or TBIN file until we get to the end of a tape block
    // return false if we are at the endfile
    struct sample_t sample;
@@ -1354,57 +1820,25 @@ bool readblock(bool retry) { // read the CSV or TBIN file until we get to the en
    samples_per_bit = bpi > 0 ? (int)(1 / (bpi*ips*sample_deltat)) : 20;
    do { // loop reading samples
       if (!retry) ++lines_in;
-      if (tbin_file) { // TBIN file
-         int16_t tbin_voltages[MAXTRKS];
-         for (int i = 0; i < subsample; ++i) { // read the subsample=nth line and ignore all the others
-            assert(fread(&tbin_voltages[0], 2, 1, inf) == 1, "can't read .tbin data for head 0 at time %.8lf", timenow);
-            if (!little_endian) reverse2((uint16_t *)&tbin_voltages[0]);
-            if (tbin_voltages[0] == -32768 /*0x8000*/) { // end of file marker
-               if (did_processing) force_end_of_block(); // force "end of block" processing
-               endfile = true;
-               goto done; }
-            assert(fread(&tbin_voltages[1], 2, nheads - 1, inf) == nheads - 1, "can't read .tbin data for heads 1.. at time %.8lf", timenow); }
-         if (!little_endian)
-            for (int head = 1; head < nheads; ++head)
-               reverse2((uint16_t *)&tbin_voltages[head]);
-         for (int head = 0; head < nheads; ++head) {
-            int trk = head_to_trk[head];
-            sample.voltage[trk] = (float)tbin_voltages[head] / 32767 * tbin_hdr.u.s.maxvolts;
-            if (invert_data) sample.voltage[trk] = -sample.voltage[trk];
-            if (do_differentiate) differentiate(&sample, trk); }
-         sample.time = (double)timenow_ns / 1e9;
-         timenow_ns += sample_deltat_ns; // (for next time)
-      }
-      else {  // CSV file
-         char line[MAXLINE + 1];
-         for (int i=0; i < subsample; ++i) // read the subsample=nth line and ignore all the others
-            if (!fgets(line, MAXLINE, inf)) {
-               if (did_processing) force_end_of_block(); // force "end of block" processing
-               endfile = true;
-               goto done; }
-         line[MAXLINE - 1] = 0;
-         /* sscanf is excruciately slow and was taking 90% of the processing time!
-         The special-purpose scan routines are about 25 times faster, but do
-         no error checking. We replaced the following code:
-         items = sscanf(line, " %lf, %f, %f, %f, %f, %f, %f, %f, %f, %f ", &sample.time,
-         &sample.voltage[0], &sample.voltage[1], &sample.voltage[2],
-         &sample.voltage[3], &sample.voltage[4], &sample.voltage[5],
-         &sample.voltage[6], &sample.voltage[7], &sample.voltage[8]);
-         assert (items == ntrks+1,"bad CSV line format"); */
-         char *linep = line;
-         sample.time = scanfast_double(&linep);  // get the time of this sample
-         for (int head = 0; head < nheads; ++head) { // read voltages for all tracks, and permute as requested
-            int trk = head_to_trk[head];
-            sample.voltage[trk] = scanfast_float(&linep);
-            if (invert_data) sample.voltage[trk] = -sample.voltage[trk];
-            if (do_differentiate) differentiate(&sample, trk); } }
+      if (!read_sample(&sample)) {
+         if (did_processing) force_end_of_block(); // force "end of block" processing
+         endfile = true;
+         goto done; }
+      if (do_differentiate)
+         for (int head = 0; head < nheads; ++head) differentiate(&sample, head_to_trk[head]);
+      if (restore_baseline) baseline_restore(&sample);
+      if (equalizing)
+         for (int trk = 0; trk < ntrks; ++trk) equalize(&sample, trk);
       ++numsamples;
       timenow = sample.time;
       if (torigin == 0) torigin = timenow; // for debugging output
+      if (replay_speed > 0 && !bidir_backward && timenow > replay_arrived) replay_wait();
 
       if (!block.window_set) { //
          // set the width of the peak-detect moving window
-         if (bpi)
+         if (bpi && speed_drift)
+            pkww_width = min(PKWW_MAX_WIDTH, (int)(PARM.pkww_bitfrac * initial_bitspacing() / sample_deltat));
+         else if (bpi)
             pkww_width = min(PKWW_MAX_WIDTH, (int)(PARM.pkww_bitfrac / (bpi*ips*sample_deltat)));
          else pkww_width = 8; // a random reasonable choice if we don't have BPI specified
          static bool said_rates = false;
@@ -1468,6 +1902,228 @@ done:;
    return !endfile; //
 } // readblock
 
+bool bidir_decode(void) { // also decode a bad PE block backwards, and splice the two decodings if we can
+   // return true if the spliced block has no errors, in which case it has replaced the forward decoding
+   static uint16_t fwd_data[MAXBLOCK + 1], fwd_faked[MAXBLOCK + 1], bwd_data[MAXBLOCK + 1], bwd_faked[MAXBLOCK + 1];
+   static struct trkstate_t fwd_trkstate[MAXTRKS];
+   static struct blkstate_t fwd_block;
+   struct results_t *result = &block.results[block.parmset];
+   struct results_t fwd = *result, bwd;
+   byte fwd_parity = expected_parity;
+   int skew_save[MAXTRKS], maxskew = 0;
+   struct file_position_t blockend;
+
+   memcpy(fwd_data, data, fwd.maxbits * sizeof(data[0])); // save the forward decoding
+   memcpy(fwd_faked, data_faked, fwd.maxbits * sizeof(data_faked[0]));
+   memcpy(fwd_trkstate, trkstate, sizeof(trkstate));
+   fwd_block = block;
+   save_file_position(&blockend, "after forward decoding");
+
+   int nsamples = (int)(blockend.nsamples - blockstart.nsamples); // buffer the samples we just decoded
+   if (nsamples > bidir_numalloc) {
+      bidir_numalloc = max(nsamples, 2 * bidir_numalloc);
+      bidir_samples = realloc(bidir_samples, bidir_numalloc * sizeof(struct sample_t));
+      assert(bidir_samples != NULLP, "can't allocate %d samples for -bidir", bidir_numalloc); }
+   restore_file_position(&blockstart, "to buffer the block for -bidir");
+   for (bidir_ndx = 0; bidir_ndx < nsamples && read_sample(&bidir_samples[bidir_ndx]); ++bidir_ndx);
+   bidir_tmirror = bidir_samples[bidir_ndx - 1].time;
+
+   for (int trk = 0; trk < ntrks; ++trk) maxskew = max(maxskew, skew_delaycnt[trk]);
+   for (int trk = 0; trk < ntrks; ++trk) { // going backwards, the tracks that were delayed the least now need the most delay
+      skew_save[trk] = skew_delaycnt[trk];
+      skew_delaycnt[trk] = maxskew - skew_delaycnt[trk]; }
+   for (int trk = 0; trk < ntrks; ++trk) bidir_bit1_up[trk] = fwd_trkstate[trk].bit1_up;
+   init_trackstate();
+   bidir_backward = true;
+   readblock(true); // ***** decode the block backwards *****
+   bidir_backward = false;
+   bwd = *result;
+   memcpy(bwd_data, data, bwd.maxbits * sizeof(data[0]));
+   memcpy(bwd_faked, data_faked, bwd.maxbits * sizeof(data_faked[0]));
+
+   for (int trk = 0; trk < ntrks; ++trk) skew_delaycnt[trk] = skew_save[trk]; // put everything back the way it was
+   memcpy(trkstate, fwd_trkstate, sizeof(trkstate));
+   block = fwd_block;
+   expected_parity = fwd_parity;
+   memcpy(data, fwd_data, fwd.maxbits * sizeof(data[0]));
+   memcpy(data_faked, fwd_faked, fwd.maxbits * sizeof(data_faked[0]));
+   restore_file_position(&blockend, "after backward decoding");
+   interblock_counter = 0;
+   if (bwd.blktype != BS_BLOCK || bwd.minbits == 0) return false;
+
+   // The forward decoding is good up to its first error, and the backward decoding is good, in reverse order, up to its
+   // first error. If the backward decoding has no errors at all we just use it, as long as it is one of the lengths the
+   // forward decoding had on some track. (If the forward decoding ran two blocks together, the backward decoding is only
+   // of the second one, and we mustn't lose the first.) Otherwise find the block lengths for which the two good parts
+   // cover the block and don't disagree anywhere they overlap, ignoring faked bits. The overlap must have at least
+   // BIDIR_AGREE_BYTES bytes, unless both decodings had that length on all tracks but maybe one extra bit going forward.
+   // (An extra bit at the end going forward is harmless, but if a track is also short going backwards, it probably lost a
+   // bit in a dropout, and the length could be the longer one.)
+   int fwd_good = fwd.first_error >= 0 ? fwd.first_error : fwd.minbits;
+   int bwd_good = bwd.first_error >= 0 ? bwd.first_error : bwd.minbits;
+   bool same_length = fwd.minbits == bwd.minbits && fwd.maxbits - fwd.minbits <= 1 && bwd.maxbits == bwd.minbits;
+   int length = -1, numfound = 0;
+   if (bwd.first_error < 0) {
+      if (bwd.minbits < fwd.minbits || bwd.minbits > fwd.maxbits) {
+         dlog("  -bidir: the backward decoding has %d bytes, but the forward one has %d-%d\n", bwd.minbits, fwd.minbits, fwd.maxbits);
+         return false; }
+      length = bwd.minbits;
+      numfound = 1;
+      fwd_good = 0; }
+   else for (int len = max(fwd_good, bwd_good); len <= fwd_good + bwd_good && len <= MAXBLOCK; ++len) {
+         bool agree = true;
+         for (int i = len - bwd_good; agree && i < fwd_good; ++i)
+            agree = ((fwd_data[i] ^ bwd_data[len - 1 - i]) & ~(fwd_faked[i] | bwd_faked[len - 1 - i])) == 0;
+         if (agree && (fwd_good + bwd_good - len >= BIDIR_AGREE_BYTES || (same_length && len == fwd.minbits))) {
+            ++numfound;
+            if (length < 0 || (same_length && len == fwd.minbits)) length = len; } }
+   dlog("  -bidir: forward %d bytes good of %d-%d, backward %d good of %d-%d, %d possible splices\n",
+        fwd_good, fwd.minbits, fwd.maxbits, bwd_good, bwd.minbits, bwd.maxbits, numfound);
+   if (numfound == 0 || (numfound > 1 && !(same_length && length == fwd.minbits)))
+      return false; // none, or too many to choose from (like for a block of all the same bytes)
+
+   for (int i = 0; i < length; ++i) { // splice them, using the forward data up to its first error unless it was faked
+      int j = length - 1 - i; // (where this byte is in the backward decoding)
+      if (i >= fwd_good || (fwd_faked[i] && j < bwd_good && !bwd_faked[j])) {
+         data[i] = bwd_data[j];
+         data_faked[i] = bwd_faked[j]; } }
+   set_expected_parity(length);
+   if (count_parity_errs(data, length) > 0) {
+      dlog("  -bidir: the spliced block of %d bytes has parity errors\n", length);
+      memcpy(data, fwd_data, fwd.maxbits * sizeof(data[0]));
+      memcpy(data_faked, fwd_faked, fwd.maxbits * sizeof(data_faked[0]));
+      expected_parity = fwd_parity;
+      return false; }
+   result->minbits = result->maxbits = length;
+   result->track_mismatch = result->vparity_errs = result->errcount = 0;
+   result->first_error = -1;
+   result->corrected_bits = count_corrected_bits(data_faked, length);
+   result->warncount = result->missed_midbits + result->corrected_bits;
+   ++numblks_bidir;
+   if (verbose_level & VL_ATTEMPTS) rlog("       block %d was repaired by splicing the backward decoding at byte %d; length %d, %d corrected bits\n",
+                                            numblks + 1, fwd_good, length, result->corrected_bits);
+   return true; }
+
+// For -vote, we keep the data from every parmset's decoding of a block. If none of them is perfect, we assemble a
+// composite block byte by byte from the decodings in which that byte passed its local check: good parity and no faked
+// bits for PE and NRZI, and a data group without uncorrected parity or ECC errors for GCR. If several decodings pass,
+// the value most of them agree on wins. The composite is then checked as a whole, using the CRC and LRC (NRZI) or the
+// block CRC (GCR) that the best decoding read, and is used if it has fewer errors than the best single decoding.
+// All of this costs memory but no more passes over the samples.
+
+struct vote_t {     // one parmset's decoding of the current block
+   uint16_t *data;     // the data
+   uint16_t *faked;    // which bits were faked
+   bool *bad;          // GCR: which bytes were in bad dgroups
+   int length;         // its length (the shortest track), or 0 if the decoding can't vote
+   int crc, lrc; };    // NRZI: the CRC and LRC that were read; GCR: the CRC and auxiliary CRC chars
+struct vote_t votes[MAXPARMSETS] = { 0 };
+
+void vote_save(void) { // remember this parmset's decoding of the block
+   struct results_t *result = &block.results[block.parmset];
+   struct vote_t *v = &votes[block.parmset];
+   v->length = 0;
+   if (result->blktype != BS_BLOCK || result->minbits == 0) return;
+   if (!v->data) {
+      v->data = malloc((MAXBLOCK + 1) * sizeof(uint16_t));
+      v->faked = malloc((MAXBLOCK + 1) * sizeof(uint16_t));
+      v->bad = malloc((MAXBLOCK + 1) * sizeof(bool));
+      assert(v->data && v->faked && v->bad, "can't allocate -vote buffers for parmset %d", block.parmset); }
+   v->length = result->minbits;
+   memcpy(v->data, data, v->length * sizeof(data[0]));
+   memcpy(v->faked, data_faked, v->length * sizeof(data_faked[0]));
+   if (mode == GCR) memcpy(v->bad, gcr_bad_bytes, v->length * sizeof(gcr_bad_bytes[0]));
+   v->crc = result->crc;
+   v->lrc = result->lrc; }
+
+bool vote_byte_ok(struct vote_t *v, int ndx) { // did this byte pass its local check?
+   if (parity(v->data[ndx]) != expected_parity) return false;
+   if (mode == PE && v->faked[ndx]) return false; // (NRZI doesn't clear faked bits between blocks)
+   if (mode == GCR && v->bad[ndx]) return false;
+   return true; }
+
+bool vote_decode(void) { // try to assemble a better block from all the decodings
+   // return true if the composite block replaced the best decoding, which block.parmset will then be
+   static uint16_t vote_data[MAXBLOCK + 1], vote_faked[MAXBLOCK + 1], saved_data[MAXBLOCK + 1], gcr_crcdata[MAXBLOCK + 8];
+   int voters[MAXPARMSETS], nvoters = 0, length = 0;
+   int best = block.parmset;
+   if (mode == WW) return false;
+   for (int i = 0; i < MAXPARMSETS; ++i) { // use the length that the most decodings have, favoring the best decoding's
+      int len = votes[i].length, count = 0;
+      if (block.results[i].blktype != BS_BLOCK || len == 0) continue;
+      for (int j = 0; j < MAXPARMSETS; ++j)
+         if (block.results[j].blktype == BS_BLOCK && votes[j].length == len) ++count;
+      if (count > nvoters || (count == nvoters && i == best)) {
+         nvoters = count;
+         length = len; } }
+   if (nvoters < 2) return false;
+   nvoters = 0;
+   if (block.results[best].blktype == BS_BLOCK && votes[best].length == length) voters[nvoters++] = best; // the best one goes first
+   for (int i = 0; i < MAXPARMSETS; ++i)
+      if (i != best && block.results[i].blktype == BS_BLOCK && votes[i].length == length) voters[nvoters++] = i;
+   if (mode != GCR) set_expected_parity(length);
+   int bad_bytes = 0, first_error = -1, bad_dgroups = 0, last_bad_dgroup = -1;
+   for (int ndx = 0; ndx < length; ++ndx) {
+      int chosen = -1, chosen_count = 0;
+      for (int pass = 0; pass < 2 && chosen < 0; ++pass) { // first only the locally good bytes, then any
+         for (int i = 0; i < nvoters; ++i) {
+            struct vote_t *v = &votes[voters[i]];
+            if (pass == 0 && !vote_byte_ok(v, ndx)) continue;
+            int count = 0;
+            for (int j = 0; j < nvoters; ++j) {
+               struct vote_t *w = &votes[voters[j]];
+               if (w->data[ndx] == v->data[ndx] && (pass == 1 || vote_byte_ok(w, ndx))) ++count; }
+            if (count > chosen_count) {
+               chosen = voters[i];
+               chosen_count = count; } }
+         if (pass == 1) { // no decoding had a good byte here
+            ++bad_bytes;
+            if (first_error < 0) first_error = ndx;
+            if (mode == GCR && ndx / 7 != last_bad_dgroup) {
+               ++bad_dgroups;
+               last_bad_dgroup = ndx / 7; } } }
+      vote_data[ndx] = votes[chosen].data[ndx];
+      vote_faked[ndx] = votes[chosen].faked[ndx]; }
+   int parity_errs = count_parity_errs(vote_data, length);
+   int crc_errs = 0, lrc_errs = 0;
+   if (mode == NRZI) { // verify the CRC and LRC of the composite, using the values the best decoding read
+      int crc, lrc;
+      memcpy(saved_data, data, (MAXBLOCK + 1) * sizeof(data[0])); // (nrzi_compute_crc_lrc uses data[])
+      memcpy(data, vote_data, length * sizeof(data[0]));
+      nrzi_compute_crc_lrc(length, 0, &crc, &lrc);
+      if (ntrks == 9 && crc != votes[voters[0]].crc) ++crc_errs;
+      if (lrc != votes[voters[0]].lrc) ++lrc_errs; }
+   if (mode == GCR) { // verify the block CRC of the composite, using the CRC chars the best decoding read
+      int dgroups = length / 7; // (and the rest are the residual bytes)
+      memcpy(gcr_crcdata, vote_data, length * sizeof(vote_data[0]));
+      for (int i = length; i < 7 * dgroups + 6; ++i) gcr_crcdata[i] = 0x001; // the zero pad bytes of the residual group
+      gcr_crcdata[7 * dgroups + 6] = votes[voters[0]].lrc;
+      if (gcr_compute_crc(gcr_crcdata, dgroups) != votes[voters[0]].crc) ++crc_errs; }
+   int errcount = parity_errs + bad_dgroups + crc_errs + lrc_errs;
+   struct results_t *result = &block.results[voters[0]];
+   dlog("  -vote: %d decodings of length %d, composite has %d bad bytes and %d errors; the best decoding has %d errors\n",
+        nvoters, length, bad_bytes, errcount, block.results[best].errcount);
+   if (errcount >= block.results[best].errcount) { // it's no better
+      if (mode == NRZI) memcpy(data, saved_data, (MAXBLOCK + 1) * sizeof(data[0]));
+      return false; }
+   memcpy(data, vote_data, length * sizeof(data[0]));
+   memcpy(data_faked, vote_faked, length * sizeof(data_faked[0]));
+   block.parmset = voters[0];
+   result->minbits = result->maxbits = length;
+   result->track_mismatch = 0;
+   result->vparity_errs = parity_errs;
+   result->ecc_errs = bad_dgroups;
+   result->crc_errs = crc_errs;
+   result->lrc_errs = lrc_errs;
+   result->first_error = first_error;
+   if (mode == PE) result->corrected_bits = count_corrected_bits(data_faked, length);
+   result->errcount = errcount + result->gcr_bad_sequence;
+   result->warncount = result->missed_midbits + result->corrected_bits + result->gcr_bad_dgroups;
+   ++numblks_voted;
+   if (verbose_level & VL_ATTEMPTS) rlog("       block %d was assembled from %d decodings by voting; length %d, %d errors\n",
+                                            numblks + 1, nvoters, length, result->errcount);
+   return true; }
+
 /***********************************************************************************************
    file processing
 ***********************************************************************************************/
@@ -1508,6 +2164,523 @@ void show_decode_status(void) { // show the results of all the decoding tries
               i, bs_names[result->blktype], result->errcount, result->warncount,
               result->minbits, result->maxbits, result->avg_bit_spacing); } }
 
+bool choose_best_parmset(void) { // pick the best of all our bad decodings of a block
+   // return true if we found one without errors
+   dlog("looking a block without errors and the minimum warning\n");
+   int min_warnings = INT_MAX;
+   for (int i = 0; i < MAXPARMSETS; ++i) { // Try 1: find a decoding with no errors and the minimum number of warnings
+      struct results_t *result = &block.results[i];
+      if (result->blktype == BS_BLOCK && result->errcount == 0 && result->warncount < min_warnings) {
+         min_warnings = result->warncount;
+         block.parmset = i; } }
+   if (min_warnings < INT_MAX) {
+      dlog("  best no-error choice is parmset %d\n", block.parmset);
+      return true; }
+
+   dlog("looking for an ok block with the minimum errors\n");
+   int min_errors = INT_MAX;
+   for (int i = 0; i<MAXPARMSETS; ++i) { // Try 2: Find the decoding with the mininum number of errors
+      struct results_t *result = &block.results[i];
+      if (result->blktype == BS_BLOCK && result->errcount < min_errors) {
+         min_errors = result->errcount;
+         block.parmset = i; } }
+   if (min_errors < INT_MAX) {
+      dlog("  best error choice is parmset %d\n", block.parmset);
+      return false; }
+
+   dlog("looking for the bad block with the minimum track difference\n");
+   int min_track_diff = INT_MAX;
+   for (int i = 0; i < MAXPARMSETS; ++i) { // Try 3: Find the decoding with the minimum difference in track lengths
+      struct results_t *result = &block.results[i];
+      if (result->blktype == BS_BADBLOCK && result->track_mismatch < min_track_diff) {
+         min_track_diff = result->track_mismatch;
+         block.parmset = i; } }
+   if (min_track_diff < INT_MAX) {
+      dlog("  best bad block choice is parmset %d with mismatch %d\n",  block.parmset, block.results[block.parmset].track_mismatch);
+      return false; }
+
+   dlog("looking for what must be a noise block\n");
+   for (int i = 0; i < MAXPARMSETS; ++i) { // Try 4: Find the first decoding which is a noise block
+      struct results_t *result = &block.results[i];
+      if (result->blktype == BS_NOISE) {
+         block.parmset = i;
+         dlog("  best block is parmset %d, which is noise\n", block.parmset);
+         return false; } }
+   assert(false, "block state error in choose_best_parmset()\n");
+   return false; }
+
+/***********************************************************************************************
+   two-phase decoding with deferred retries
+
+   Phase 1 decodes every block with only the starting parmset, and spools what it decoded to a
+   temporary file: the results, the data, and where the block started and ended. The blocks
+   that weren't perfect are also queued. Phase 2 then retries just those blocks with the other
+   parmsets, within a time limit for each block and for the whole tape, and spools any better
+   decoding it finds. (If that decoding ends somewhere other than where phase 1's did, as when
+   phase 1 merged two blocks, the blocks after it are decoded and spooled again from its end.)
+   Finally the spooled decodings are written out in tape order, so nothing is decoded a third
+   time, and a stretch of terrible blocks can't hold up the processing of everything behind it.
+   The models learn from the phase 1 decodings, as they are made.
+***********************************************************************************************/
+struct spool_t {                  // a decoding in the spool file, which is followed by its data[] and data_faked[]
+   struct file_position_t start;  // where we started looking for the block
+   struct file_position_t next;   // where we started looking for the following block
+   double t_blockstart;           // when the data started
+   int parmset, tries;            // the parmset that decoded it, and how many we tried
+   byte expected_parity;
+   struct results_t result; };
+struct retry_t {                  // a block that wasn't perfect in phase 1
+   int ndx;                       // its index in spoolq
+   int parmset;                   // the best parmset we found for it
+   struct results_t result; };    // and the results of that decoding
+static FILE *spoolf;
+static int64_t *spoolq;           // where each decoding in tape order is in the spool file
+static int spoolq_count, spoolq_allocated;
+static struct retry_t retryq[MAXRETRYBLKS];
+static int retryq_count;
+static int spool_nblks;           // how many data blocks are in spoolq
+static bool retryq_full;
+
+static double secs_since(clock_t start) {
+   return (double)(clock() - start) / CLOCKS_PER_SEC; }
+
+static int64_t spool_save(struct file_position_t *start) { // spool the decoding we just did, and return where it is
+   struct results_t *result = &block.results[block.parmset];
+   struct spool_t sp;
+   memset(&sp, 0, sizeof(sp));
+   sp.start = *start;
+   save_file_position(&sp.next, "after a spooled block");
+   sp.t_blockstart = block.t_blockstart;
+   sp.parmset = block.parmset;
+   sp.tries = block.tries;
+   sp.expected_parity = expected_parity;
+   sp.result = *result;
+   int length = result->blktype == BS_TAPEMARK ? 0 : min(max(result->maxbits, 0), MAXBLOCK);
+   assert(fseeko(spoolf, 0, SEEK_END) == 0, "fseek failed");
+   int64_t pos = ftello(spoolf);
+   assert(fwrite(&sp, sizeof(sp), 1, spoolf) == 1
+          && fwrite(data, sizeof(data[0]), length, spoolf) == length
+          && fwrite(data_faked, sizeof(data_faked[0]), length, spoolf) == length, "can't write the -twophase spool file");
+   return pos; }
+
+static void spool_write_block(int64_t pos) { // write out a spooled decoding as if we had just done it
+   struct spool_t sp;
+   assert(fseeko(spoolf, pos, SEEK_SET) == 0, "fseek failed");
+   assert(fread(&sp, sizeof(sp), 1, spoolf) == 1, "can't read the -twophase spool file");
+   int length = sp.result.blktype == BS_TAPEMARK ? 0 : min(max(sp.result.maxbits, 0), MAXBLOCK);
+   assert(fread(data, sizeof(data[0]), length, spoolf) == length
+          && fread(data_faked, sizeof(data_faked[0]), length, spoolf) == length, "can't read the -twophase spool file");
+   init_blockstate();
+   block.parmset = sp.parmset;
+   block.tries = sp.tries;
+   block.t_blockstart = sp.t_blockstart;
+   block.results[block.parmset] = sp.result;
+   expected_parity = sp.expected_parity;
+   restore_file_position(&sp.next, "to write a spooled block"); // (for the times, and the .tbin damage check)
+   blockstart = sp.start;
+   ++PARM.chosen;
+   spool_writing = true;
+   if (sp.result.blktype == BS_TAPEMARK) got_tapemark();
+   else got_datablock(sp.result.blktype == BS_BADBLOCK);
+   spool_writing = false; }
+
+static void two_phase_spool_rest(void) { // phase 1: decode and spool the blocks from here on with only the starting parmset
+   while (spool_nblks < numblks_limit) {
+      struct file_position_t start;
+      init_blockstate();
+      block.parmset = starting_parmset;
+      save_file_position(&start, "phase 1 block start");
+      blockstart = start; // (for bidir_decode, which rereads the block from there)
+      init_trackstate();
+      bool endfile = !readblock(false);
+      struct results_t *result = &block.results[block.parmset];
+      if (result->blktype == BS_NONE) break; // stuff at the end wasn't a real block
+      block.tries = 1;
+      ++PARM.tried;
+      if (bidir && mode == PE && !endfile // try decoding a bad PE block backwards too
+            && result->blktype == BS_BLOCK && result->minbits > 0 && result->errcount > 0) bidir_decode();
+      if (result->blktype == BS_NOISE) {
+         if (endfile) break;
+         continue; }
+      if (spoolq_count >= spoolq_allocated) {
+         spoolq_allocated = spoolq_allocated ? 2 * spoolq_allocated : 1024;
+         spoolq = realloc(spoolq, spoolq_allocated * sizeof(int64_t));
+         assert(spoolq != NULLP, "can't allocate the -twophase spool index"); }
+      spoolq[spoolq_count] = spool_save(&start);
+      if (result->blktype != BS_TAPEMARK) {
+         ++spool_nblks;
+         bool badblock = result->blktype == BS_BADBLOCK;
+         if ((badblock || result->errcount > 0 || result->warncount > 0)
+               && (mode != PE || result->minbits != 0)) { // (dead PE tracks probably mean we saw noise)
+            if (retryq_count < MAXRETRYBLKS) { // queue it for phase 2
+               struct retry_t *r = &retryq[retryq_count++];
+               r->ndx = spoolq_count;
+               r->parmset = block.parmset;
+               r->result = *result; }
+            else if (!retryq_full) {
+               rlog("   WARNING: more than %d blocks need retries; the rest will use parmset %d\n", MAXRETRYBLKS, starting_parmset);
+               retryq_full = true; } }
+         if (adjdeskew && mode == NRZI) adjust_deskew(nrzi.clkavg.t_bitspaceavg);
+         models_block_done(result->minbits, !badblock && result->errcount == 0); }
+      ++spoolq_count;
+      if (endfile) break; } }
+
+static void two_phase_unspool(int ndx) { // forget the spooled decodings from spoolq[ndx] on
+   for (int i = ndx; i < spoolq_count; ++i) {
+      struct spool_t sp;
+      assert(fseeko(spoolf, spoolq[i], SEEK_SET) == 0 && fread(&sp, sizeof(sp), 1, spoolf) == 1, "can't read the -twophase spool file");
+      if (sp.result.blktype != BS_TAPEMARK) --spool_nblks; }
+   spoolq_count = ndx;
+   while (retryq_count > 0 && retryq[retryq_count - 1].ndx >= ndx) --retryq_count;
+   retryq_full = false; }
+
+bool two_phase_decode(void) { // decode, retry, and write the whole file; return true if all the blocks are perfect
+   spoolf = tmpfile();
+   assert(spoolf != NULLP, "can't create the -twophase spool file");
+   spoolq_count = retryq_count = spool_nblks = 0;
+   retryq_full = false;
+   bool ok = true;
+   clock_t phase_start = clock();
+   if (!quiet) rlog("\nphase 1: decoding all blocks with parmset %d\n", starting_parmset);
+   two_phase_spool_rest();
+   struct file_position_t phase1_end;
+   save_file_position(&phase1_end, "at the end of phase 1");
+   if (!quiet) rlog("  %d blocks were decoded in %.1f seconds, and %d need to be retried\n",
+                       spool_nblks, secs_since(phase_start), retryq_count);
+
+   phase_start = clock();
+   int num_improved = 0, num_perfect = 0, num_cutshort = 0, num_skipped = 0, num_moved = 0;
+   if (!quiet && retryq_count > 0) rlog("phase 2: retrying %d blocks with other parmsets\n", retryq_count);
+   for (int ndx = 0; ndx < retryq_count; ++ndx) {
+      struct retry_t *r = &retryq[ndx];
+      struct spool_t sp; // (for where the block started)
+      assert(fseeko(spoolf, spoolq[r->ndx], SEEK_SET) == 0 && fread(&sp, sizeof(sp), 1, spoolf) == 1, "can't read the -twophase spool file");
+      if (retry_tape_secs > 0 && secs_since(phase_start) >= retry_tape_secs) {
+         num_skipped = retryq_count - ndx; // we ran out of time for the whole tape
+         break; }
+      init_blockstate();  // start with what phase 1 found
+      block.results[r->parmset] = r->result;
+      block.parmset = r->parmset;
+      block.tries = 1;
+      clock_t block_start = clock();
+      int next_parmset = r->parmset, last_parmset = r->parmset;
+      while (1) { // try all the other active parmsets, until one is perfect or we run out of time
+         if (++next_parmset >= MAXPARMSETS) next_parmset = 0;
+         if (next_parmset == r->parmset) break;
+         if (parmsetsptr[next_parmset].active == 0) continue;
+         if ((retry_block_secs > 0 && secs_since(block_start) >= retry_block_secs)
+               || (retry_tape_secs > 0 && secs_since(phase_start) >= retry_tape_secs)) {
+            ++num_cutshort;
+            break; }
+         block.parmset = last_parmset = next_parmset;
+         restore_file_position(&sp.start, "to retry a phase 1 block");
+         interblock_counter = 0;
+         init_trackstate();
+         readblock(true);
+         ++block.tries;
+         ++PARM.tried;
+         struct results_t *result = &block.results[block.parmset];
+         if (verbose_level & VL_ATTEMPTS) rlog("       retry of block at %.8lf is type %s with parmset %d; %d errors, %d warnings\n",
+                                                  sp.start.time, bs_names[result->blktype], block.parmset, result->errcount, result->warncount);
+         if (result->blktype == BS_BLOCK && result->errcount == 0 && result->warncount == 0) {
+            ++num_perfect;
+            ++numblks_goodmultiple;
+            break; } }
+      choose_best_parmset();
+      if (block.parmset == r->parmset) continue;
+      ++num_improved;
+      dlog("  block at %.8lf will use parmset %d instead of %d\n", sp.start.time, block.parmset, r->parmset);
+      if (block.parmset != last_parmset) { // reprocess the chosen decoding to recompute its data
+         restore_file_position(&sp.start, "to recompute the best decoding");
+         interblock_counter = 0;
+         rereading = true;
+         init_trackstate();
+         readblock(true);
+         rereading = false; }
+      r->parmset = block.parmset;
+      r->result = block.results[block.parmset];
+      spoolq[r->ndx] = spool_save(&sp.start);
+      struct file_position_t next;
+      save_file_position(&next, "after a retried block");
+      if (next.nsamples != sp.next.nsamples) { // it ended somewhere else, so what follows has to be decoded again
+         // (If phase 1 had merged this block with the next one, that one would otherwise be lost.)
+         dlog("  block at %.8lf now ends at %.8lf instead of %.8lf, so we are decoding what follows again\n",
+              sp.start.time, next.time, sp.next.time);
+         ++num_moved;
+         two_phase_unspool(r->ndx + 1);
+         interblock_counter = 0;
+         two_phase_spool_rest();
+         save_file_position(&phase1_end, "at the end of phase 1 again"); } }
+   if (!quiet && retryq_count > 0) {
+      rlog("  %d blocks were improved, %d of them to perfect, in %.1f seconds\n", num_improved, num_perfect, secs_since(phase_start));
+      if (num_cutshort) rlog("  %d blocks didn't try all parmsets because of the time limits\n", num_cutshort);
+      if (num_skipped) rlog("  %d blocks weren't retried because the tape time limit was reached\n", num_skipped);
+      if (num_moved) rlog("  %d blocks ended somewhere else when retried, so the blocks after them were decoded again\n", num_moved); }
+
+   if (!quiet) rlog("writing the blocks in tape order\n");
+   for (int ndx = 0; ndx < spoolq_count; ++ndx) {
+      spool_write_block(spoolq[ndx]);
+      if (block.results[block.parmset].errcount > 0) ok = false; }
+   restore_file_position(&phase1_end, "after writing the spooled blocks");
+   fclose(spoolf);
+   free(spoolq);
+   spoolq = NULLP;
+   spoolq_allocated = 0;
+   return ok; }
+
+/***********************************************************************************************
+   deadline-bounded decoding, for -deadline
+
+   For live decoding, one terrible block that goes through all the parmsets can make us fall
+   far behind the capture. With -deadline=x we stop trying new parmsets for a block after x
+   seconds and write the best decoding we have. We remember where the block started, which
+   parmsets were tried, and where its record went in the output file. At the end of the input
+   those blocks are decoded with the parmsets they didn't get to, and if one is better and has
+   the same length, the record is rewritten in place. (The -txtfile listing and the block counts
+   in the log still describe what was first written. The hashes in a manifest would be stale, so
+   -deadline isn't allowed with -manifest, or with -redecode, which writes one. Nor is it allowed
+   with -mixed, because the retries would use the format of the last file, not the block's.)
+   The time limit is on the wall clock, as for -replay, because that's what the capture runs on.
+***********************************************************************************************/
+struct deadline_t {               // a block whose decoding was cut short
+   struct file_position_t start;  // where we started looking for the block
+   uint32_t tried;                // which parmsets were tried, one bit each
+   int parmset;                   // the parmset whose decoding was written
+   struct results_t result;       // and the results of that decoding
+   bool damaged;                  // was it decoded from bad .tbin data?
+   int64_t outpos;                // where its record starts in the output file
+   char *outfilename; };          // and the name of that file
+static struct deadline_t deadlineq[MAXRETRYBLKS];
+static int deadlineq_count;
+
+static bool usable_decoding(void) { // do we have a decoding of the block that would be written?
+   // (An unusable block isn't written, so there would be no record to rewrite later. We keep trying those.)
+   for (int i = 0; i < MAXPARMSETS; ++i)
+      if (block.results[i].blktype == BS_BLOCK) return true;
+   return false; }
+
+static void deadline_queue(struct file_position_t *start) { // remember a block that was written before trying all the parmsets
+   uint32_t tried = 0;
+   bool untried = false;
+   for (int i = 0; i < MAXPARMSETS; ++i) {
+      if (block.results[i].blktype != BS_NONE) tried |= 1 << i;
+      else if (parmsetsptr[i].active) untried = true; }
+   if (!untried) return;
+   ++numblks_cutshort;
+   if (deadlineq_count >= MAXRETRYBLKS) {
+      if (deadlineq_count++ == MAXRETRYBLKS)
+         rlog("   WARNING: more than %d blocks were cut short by -deadline; the rest won't be retried\n", MAXRETRYBLKS);
+      return; }
+   struct deadline_t *d = &deadlineq[deadlineq_count++];
+   d->start = *start;
+   d->tried = tried;
+   d->parmset = block.parmset;
+   d->result = block.results[block.parmset];
+   d->damaged = record_damaged;
+   d->outpos = record_outpos;
+   d->outfilename = malloc(strlen(outdatafilename) + 1);
+   assert(d->outfilename != NULLP, "can't allocate -deadline file name");
+   strcpy(d->outfilename, outdatafilename);
+   if (verbose_level & VL_ATTEMPTS) rlog("       block %d was cut short by -deadline after %d tries\n", numblks, block.tries); }
+
+static void deadline_rewrite(struct deadline_t *d) { // rewrite a record with the decoding in data[]
+   struct results_t *result = &block.results[block.parmset];
+   int length = result->minbits;
+   FILE *f = fopen(d->outfilename, "r+b");
+   assert(f != NULLP, "can't reopen \"%s\" to rewrite a block", d->outfilename);
+   assert(fseeko(f, d->outpos, SEEK_SET) == 0, "fseek failed");
+   uint32_t marker = length | (result->errcount ? 0x80000000 : 0); // (the error flag might have changed)
+   if (tap_format) // rewrite the leading record length
+      for (int i = 0; i < 4; ++i) assert(fputc((marker >> (8 * i)) & 0xff, f) != EOF, "can't rewrite record length");
+   assert(fwrite(record_bytes(length), 1, length, f) == length, "can't rewrite block data");
+   if (tap_format) { // and the trailing one
+      if (length & 1) assert(fseeko(f, 1, SEEK_CUR) == 0, "fseek failed"); // (skip the pad byte)
+      for (int i = 0; i < 4; ++i) assert(fputc((marker >> (8 * i)) & 0xff, f) != EOF, "can't rewrite record length"); }
+   fclose(f); }
+
+void deadline_retries(void) { // finish the blocks that -deadline cut short
+   int count = min(deadlineq_count, MAXRETRYBLKS), num_changed_length = 0;
+   if (count == 0) return;
+   clock_t start = clock();
+   if (!quiet) rlog("\nretrying %d blocks that were cut short by -deadline\n", count);
+   for (int ndx = 0; ndx < count; ++ndx) {
+      struct deadline_t *d = &deadlineq[ndx];
+      init_blockstate();  // start with what was written
+      block.results[d->parmset] = d->result;
+      block.tries = 1;
+      int last_parmset = d->parmset;
+      for (int parmset = 0; parmset < MAXPARMSETS; ++parmset) { // try all the parmsets that weren't tried
+         if (parmsetsptr[parmset].active == 0 || d->tried & (1 << parmset)) continue;
+         block.parmset = last_parmset = parmset;
+         restore_file_position(&d->start, "to finish a block cut short");
+         interblock_counter = 0;
+         init_trackstate();
+         readblock(true);
+         ++block.tries;
+         ++PARM.tried;
+         struct results_t *result = &block.results[block.parmset];
+         if (result->blktype == BS_BLOCK && result->errcount == 0 && result->warncount == 0) break; }
+      choose_best_parmset();
+      struct results_t *result = &block.results[block.parmset];
+      if (d->damaged) tbin_mark_damaged(result); // (the new decoding is from the same bad data)
+      if (block.parmset == d->parmset || result->blktype != BS_BLOCK // is it better than what we wrote?
+            || result->errcount > d->result.errcount
+            || (result->errcount == d->result.errcount && result->warncount >= d->result.warncount)) continue;
+      if (result->minbits != d->result.minbits) { // we can't rewrite it in place
+         rlog("   the block at %.8lf is better with parmset %d but has a different length, %d instead of %d, so it wasn't rewritten\n",
+              d->start.time, block.parmset, result->minbits, d->result.minbits);
+         ++num_changed_length;
+         continue; }
+      if (block.parmset != last_parmset) { // reprocess the chosen decoding to recompute its data
+         restore_file_position(&d->start, "to recompute the best decoding");
+         interblock_counter = 0;
+         rereading = true;
+         init_trackstate();
+         readblock(true);
+         rereading = false;
+         if (d->damaged) tbin_mark_damaged(result); }
+      deadline_rewrite(d);
+      ++numblks_patched;
+      ++PARM.chosen;
+      --parmsetsptr[d->parmset].chosen;
+      if (!quiet) rlog("   rewrote the block at %.8lf using parmset %d, now with %d errors and %d warnings instead of %d and %d\n",
+                          d->start.time, block.parmset, result->errcount, result->warncount, d->result.errcount, d->result.warncount); }
+   for (int ndx = 0; ndx < count; ++ndx) free(deadlineq[ndx].outfilename);
+   if (!quiet) rlog("  %d blocks were rewritten%s in %.1f seconds\n", numblks_patched,
+                       num_changed_length ? ", and some better ones weren't because their length changed," : "", secs_since(start));
+   deadlineq_count = 0; }
+
+/***********************************************************************************************
+   mixed formats on one tape, for -mixed
+
+   Some tapes have a label or a first file written at one density or with one encoding, and
+   the rest at another. With -mixed we look ahead after each tapemark, as we do at the start
+   of the tape to estimate the density, and decide from the transition spacings which of the
+   standard formats the next file is in. If it isn't the one we're using, we switch to its
+   decoder, reload the parmsets for that encoding, and start the learned models over.
+***********************************************************************************************/
+void mixed_check_format(void) { // see if the data that follows is in a different format
+   struct file_position_t here;
+   save_file_position(&here, "before checking the format");
+   float savedbpi = bpi, newbpi = 0;
+   bpi = 0; // use the same peak detection window as for the density estimate at the start
+   float min_peak = parmsetsptr[starting_parmset].min_peak;
+   parmsetsptr[starting_parmset].min_peak = 0; // and don't let this encoding's peak height threshold hide the smaller peaks of another
+   bool zeros = find_zeros;
+   find_zeros = false; // (the estimate is based on peaks)
+   doing_density_detection = true;
+   estden_init_format();
+   do {
+      init_blockstate();
+      block.parmset = starting_parmset;
+      init_trackstate();
+      if (!readblock(true)) break; } // stop if endfile
+   while (!estden_done()); // (which is at the end of the first block that had enough transitions)
+   doing_density_detection = false;
+   parmsetsptr[starting_parmset].min_peak = min_peak;
+   find_zeros = zeros;
+   restore_file_position(&here, "after checking the format");
+   interblock_counter = 0;
+   bpi = savedbpi;
+   enum mode_t newmode = estden_format(&newbpi);
+   if (newmode == UNKNOWN || (newmode == mode && newbpi == bpi)) return; // no change, or we can't tell
+   char *oldname = modename();
+   enum mode_t oldmode = mode;
+   float oldbpi = bpi;
+   mode = newmode;
+   bpi = newbpi;
+   if (oldbpi == 0) { // we're at the start of the tape and didn't know the density yet
+      if (!quiet) rlog("  the format was set to %s at %.0f BPI (%.2f usec/bit)\n", modename(), bpi, 1e6 / (bpi*ips)); }
+   else {
+      rlog("\n*** the format changed from %s at %.0f BPI to %s at %.0f BPI after the tapemark at %.8lf\n",
+           oldname, oldbpi, modename(), bpi, timenow);
+      ++num_format_changes; }
+   if (mode != oldmode) {
+      read_parms(); // get the parmsets for the new encoding
+      starting_parmset = 0; }
+   models_init(); } // and start over on what we learned about the old format
+
+/***********************************************************************************************
+   incremental redecoding of an earlier run
+
+   With -redecode=bbb, the records that bbb.manifest.csv says were perfect are copied from
+   bbb.tap, and only the others are decoded again, starting at the input file position where
+   the earlier run started looking for them. If the new decoding isn't better, the old one is
+   kept. The new .tap file and manifest are complete, so the next run can redecode from them.
+***********************************************************************************************/
+static struct manifest_rec_t *redecode_pending = NULLP; // the record we are decoding again
+static byte redecode_buf[MAXBLOCK + 1], redecode_pending_buf[MAXBLOCK + 1];
+
+static void redecode_copy(struct manifest_rec_t *r, byte *buf) { // write a record from the earlier run
+   double time_saved = timenow;
+   init_blockstate();
+   block.parmset = r->parmset >= 0 && r->parmset < MAXPARMSETS ? r->parmset : 0;
+   block.t_blockstart = r->tstart;
+   blockstart = r->start;
+   timenow = r->tend; // (for the log and the manifest)
+   if (r->tapemark) got_tapemark();
+   else if (r->unusable) { // we didn't do any better this time
+      ++numblks_unusable;
+      if (!quiet) rlog("ERROR: the unusable block at time %.8lf is still unusable\n", r->tend);
+      manifest_unusable(r->tstart, r->tend, r->errcount, r->warncount, block.parmset, &blockstart);
+      save_file_position(&blockstart, "after an unusable block"); }
+   else {
+      struct results_t *result = &block.results[block.parmset];
+      result->blktype = BS_BLOCK;
+      result->minbits = result->maxbits = r->length;
+      result->errcount = r->errcount;
+      result->warncount = r->warncount;
+      result->avg_bit_spacing = bpi > 0 && ips > 0 ? 1 / (bpi * ips) : 0;
+      result->alltrk_min_agc_gain = FLT_MAX;
+      result->alltrk_max_agc_gain = 1;
+      for (int i = 0; i < r->length; ++i) { // recreate the data as if we had decoded it
+         if (add_parity) data[i] = (uint16_t)((buf[i] & ~(1 << (ntrks - 1))) << 1 | (buf[i] >> (ntrks - 1) & 1));
+         else data[i] = (uint16_t)(buf[i] << 1);
+         data_faked[i] = 0; }
+      redecode_copying = true;
+      got_datablock(false);
+      redecode_copying = false; }
+   timenow = time_saved; }
+
+// copy the earlier run's records until we get to one that wasn't perfect, and position the input
+// file to where its decoding started; return false if there are no more records
+static bool redecode_skip(void) {
+   if (redecode_pending) { // the last thing we found was noise, so we are still looking for it
+      struct file_position_t here;
+      struct manifest_rec_t *next = redecode_peek();
+      save_file_position(&here, "while looking for a block to redecode");
+      if (next == NULLP || here.position < next->start.position) return true;
+      rlog("   WARNING: the block at %.8lf wasn't found again, so the earlier decoding was used\n", redecode_pending->tstart);
+      ++numblks_redecode_lost;
+      redecode_copy(redecode_pending, redecode_pending_buf);
+      redecode_pending = NULLP; }
+   struct manifest_rec_t *r;
+   while ((r = redecode_next(redecode_buf)) != NULLP) {
+      if (r->tapemark || (r->errcount == 0 && r->warncount == 0)) {
+         if (!r->tapemark) ++numblks_copied;
+         redecode_copy(r, redecode_buf);
+         continue; }
+      restore_file_position(&r->start, "to redecode a block");
+      interblock_counter = 0;
+      memcpy(redecode_pending_buf, redecode_buf, r->length);
+      redecode_pending = r;
+      ++numblks_redecoded;
+      return true; }
+   return false; }
+
+// we have decoded a block again; return true if the earlier decoding was better and we used it instead
+static bool redecode_keep_old(void) {
+   struct results_t *result = &block.results[block.parmset];
+   struct manifest_rec_t *r = redecode_pending;
+   redecode_pending = NULLP;
+   if (result->blktype == BS_BLOCK
+         && (r->unusable || result->errcount < r->errcount || (result->errcount == r->errcount && result->warncount <= r->warncount))) {
+      if (r->unusable || result->errcount < r->errcount || result->warncount < r->warncount) ++numblks_redecode_improved;
+      return false; }
+   ++numblks_redecode_kept;
+   redecode_copy(r, redecode_pending_buf);
+   return true; }
+
 //*** process a complete input file whose path and base file name are in baseinfilename[]
 //*** return TRUE only if all blocks were well-formed and error-free
 
@@ -1528,6 +2701,11 @@ bool process_file(int argc, char *argv[], const char *extension) {
    if (logging) { // Open the log file
       sprintf(logfilename, "%s.log", baseoutfilename);
       assert((rlogf = fopen(logfilename, "w")) != NULLP, "Unable to open log file \"%s\"", logfilename); }
+   if (manifest) manifest_open();
+   if (redecode_basefilename[0]) {
+      assert(strcmp(redecode_basefilename, baseoutfilename) != 0, "-redecode needs a different output file name; use -outf or -outp");
+      redecode_open(redecode_basefilename);
+      redecode_pending = NULLP; }
 
    indatafilename[MAXPATH - 5] = '\0';
    inf = NULL;
@@ -1546,6 +2724,8 @@ bool process_file(int argc, char *argv[], const char *extension) {
       show_program_info(argc, argv);
       rlog("\nreading file \"%s\"\n", indatafilename);
       rlog("the output files will be \"%s.xxx\"\n", baseoutfilename); }
+   planar_groupsize = 0; // (read_tbin_header sets it for planar files)
+   replay_reset();
    if (tbin_file) read_tbin_header();  // sets NRZI, etc., so do before read_parms()
 
    read_parms(); // read the .parm file, if any
@@ -1589,6 +2769,9 @@ bool process_file(int argc, char *argv[], const char *extension) {
          assert(!endfile, "endfile with %d lines left to skip\n", skip_samples); } }
    interblock_counter = 0;
    starting_parmset = 0;
+   if (mode == WW) speed_drift = track_health = equalizing = restore_baseline = learn_peakshift = false; // (the models aren't for Whirlwind)
+   if (do_differentiate) restore_baseline = false; // (differentiation already removes any DC offset)
+   models_init();
 
    assert(!add_parity || ntrks < 9, "-parity not allowed with ntrks=%d", ntrks);
    if (head_to_trk[0] == -1 // if no input track permutation was given
@@ -1601,6 +2784,7 @@ bool process_file(int argc, char *argv[], const char *extension) {
       if (bpi != 9042) rlog ("BPI was reset to 9042 for GCR 6250\n");
       bpi = 9042; } // the real BPI isn't 6250!
 
+   if (bpi == 0 && mixed_formats && mode != WW) mixed_check_format(); // auto-detect the encoding too
    if (bpi == 0) {  // **** auto-detect the density by looking at how close transitions are at the start of the tape
       doing_density_detection = true;
       estden_init();
@@ -1664,8 +2848,16 @@ bool process_file(int argc, char *argv[], const char *extension) {
                rlog("\n"); }
             doing_deskew = false; } } }
 #endif
+   assert(!two_phase || !follow_secs, "-twophase and -follow can't be used together");
+   assert(deadline_secs == 0 || (!two_phase && !manifest && !mixed_formats && mode != WW), "-deadline can't be used with -twophase, -manifest, -redecode, -mixed, or Whirlwind");
+   assert(!mixed_formats || (!two_phase && !redecode_basefilename[0] && mode != WW), "-mixed can't be used with -twophase, -redecode, or Whirlwind");
+   assert(!redecode_basefilename[0] || (!two_phase && !follow_secs && mode != WW), "-redecode can't be used with -twophase, -follow, or Whirlwind");
+   if (two_phase) { // do the quick decode and the deferred retries, and write everything
+      if (!two_phase_decode()) ok = false;
+      goto endfile; }
    bool endfile = false;
    while (!endfile && numblks < numblks_limit) { // keep processing lines of the file for more blocks
+      if (redecode_basefilename[0] && !redecode_skip()) goto endfile; // copy perfect records from the earlier run
       init_blockstate();  // initialize for first processing of a new block
       block.parmset = starting_parmset;
       save_file_position(&blockstart, "to remember block start"); // remember the file position for the start of a block
@@ -1674,6 +2866,8 @@ bool process_file(int argc, char *argv[], const char *extension) {
       bool keep_trying;
       int last_parmset;
       block.tries = 0;
+      double block_wall = wall_secs();  // for -deadline
+      bool cut_short = false;
 
 #if GCR_PARMSCAN // Scan for optimal sets of GCR parms for the first block
       if (numblks == 0) {
@@ -1718,13 +2912,21 @@ bool process_file(int argc, char *argv[], const char *extension) {
          ++PARM.tried;  // note that we used this parameter set in another attempt
          if (verbose_level & VL_ATTEMPTS) rlog("       block %d is type %s with parmset %d; minlength %d, maxlength %d, %d errors, %d warnings, %d corrected bits at %.8lf\n", //
                                                   numblks + 1, bs_names[result->blktype], block.parmset, result->minbits, result->maxbits, result->errcount, result->warncount, result->corrected_bits, timenow);
+         if (vote) vote_save();
          if (result->blktype == BS_TAPEMARK) goto done;  // if we got a tapemake, we're done
          if (result->blktype == BS_NOISE && SKIP_NOISE) goto done; // if we got noise and are immediately skipping noise blocks, we're done
-         if (result->blktype == BS_BLOCK && result->errcount == 0 && result->warncount == 0) { // if we got a perfect block, we're done
+         if (result->blktype == BS_BLOCK && result->errcount == 0 // if we got a perfect block, we're done
+               && (result->warncount == 0 // (or one that GCR ECC or NRZI CRC/LRC correction made good, but not PE
+                   || (correct_first && (mode == GCR || mode == NRZI) && result->corrected_bits > 0))) { //  bits checked only by parity)
             if (block.tries>1) ++numblks_goodmultiple;  // bragging rights; perfect blocks due to multiple parameter sets
             goto done; }
-         if (multiple_tries &&  // if we're supposed to try multiple times
-               (mode != PE || result->minbits != 0)) { // and there are no dead PE tracks (which probably means we saw noise)
+         if (bidir && mode == PE && block.tries == 1 && !endfile // try decoding a bad PE block backwards too
+               && result->blktype == BS_BLOCK && result->minbits > 0 && result->errcount > 0 && bidir_decode())
+            goto done;
+         if (deadline_secs > 0 && multiple_tries && wall_secs() - block_wall >= deadline_secs && usable_decoding())
+            cut_short = true; // we've run out of time, so use what we have and finish it at the end
+         else if (multiple_tries &&  // if we're supposed to try multiple times now
+                  (mode != PE || result->minbits != 0)) { // and there are no dead PE tracks (which probably means we saw noise)
             int next_parmset = block.parmset; // then find another parameter set we haven't used yet
             do {
                if (++next_parmset >= MAXPARMSETS) next_parmset = 0; }
@@ -1743,50 +2945,10 @@ bool process_file(int argc, char *argv[], const char *extension) {
 
       if (block.tries == 1) { // unless we don't have multiple decoding tries
          if (block.results[block.parmset].errcount > 0) ok = false; }
-      else {
-
-         dlog("looking a block without errors and the minimum warning\n");
-         int min_warnings = INT_MAX;
-         for (int i = 0; i < MAXPARMSETS; ++i) { // Try 1: find a decoding with no errors and the minimum number of warnings
-            struct results_t *result = &block.results[i];
-            if (result->blktype == BS_BLOCK && result->errcount == 0 && result->warncount < min_warnings) {
-               min_warnings = result->warncount;
-               block.parmset = i; } }
-         if (min_warnings < INT_MAX) {
-            dlog("  best no-error choice is parmset %d\n", block.parmset);
-            goto done; }
-         ok = false; // we had at least one bad block
-
-         dlog("looking for an ok block with the minimum errors\n");
-         int min_errors = INT_MAX;
-         for (int i = 0; i<MAXPARMSETS; ++i) { // Try 2: Find the decoding with the mininum number of errors
-            struct results_t *result = &block.results[i];
-            if (result->blktype == BS_BLOCK && result->errcount < min_errors) {
-               min_errors = result->errcount;
-               block.parmset = i; } }
-         if (min_errors < INT_MAX) {
-            dlog("  best error choice is parmset %d\n", block.parmset);
-            goto done; }
-
-         dlog("looking for the bad block with the minimum track difference\n");
-         int min_track_diff = INT_MAX;
-         for (int i = 0; i < MAXPARMSETS; ++i) { // Try 3: Find the decoding with the minimum difference in track lengths
-            struct results_t *result = &block.results[i];
-            if (result->blktype == BS_BADBLOCK && result->track_mismatch < min_track_diff) {
-               min_track_diff = result->track_mismatch;
-               block.parmset = i; } }
-         if (min_track_diff < INT_MAX) {
-            dlog("  best bad block choice is parmset %d with mismatch %d\n",  block.parmset, block.results[block.parmset].track_mismatch);
-            goto done; }
-
-         dlog("looking for what must be a noise block\n");
-         for (int i = 0; i < MAXPARMSETS; ++i) { // Try 4: Find the first decoding which is a noise block
-            struct results_t *result = &block.results[i];
-            if (result->blktype == BS_NOISE) {
-               block.parmset = i;
-               dlog("  best block is parmset %d, which is noise\n", block.parmset);
-               goto done; } }
-         assert(false, "block state error in process_file()\n"); }
+      else if (!choose_best_parmset()) { // we had at least one bad block
+         if (vote && vote_decode()) // but maybe we can assemble a better one from all the decodings
+            last_parmset = block.parmset; // (which mustn't be reread)
+         if (block.results[block.parmset].errcount > 0) ok = false; }
 
 done:;
       struct results_t *result = &block.results[block.parmset];
@@ -1808,16 +2970,22 @@ done:;
             dlog("     reread of block %d with parmset %d is type %s, minlength %d, maxlength %d, %d errors, %d corrected bits at %.8lf\n", //
                  numblks + 1, block.parmset, bs_names[result->blktype], result->minbits, result->maxbits, result->errcount, result->corrected_bits, timenow); }
 
-         switch (block.results[block.parmset].blktype) {  // process the block according to our best decoding
+         record_outpos = -1;
+         struct file_position_t thisblock = blockstart; // (got_datablock moves it to the next block)
+         if (redecode_pending && redecode_keep_old()); // we decoded it again, but the earlier decoding was better
+         else switch (block.results[block.parmset].blktype) {  // process the block according to our best decoding
          case BS_TAPEMARK:
-            got_tapemark(); break;
+            got_tapemark();
+            if (mixed_formats) mixed_check_format(); // the next file might be in a different format
+            break;
          case BS_BLOCK:
             got_datablock(false); break;
          case BS_BADBLOCK:
             got_datablock(true); break;
          default:
             fatal("bad block state after decoding", ""); //
-         } }
+         }
+         if (cut_short && record_outpos >= 0) deadline_queue(&thisblock); }
 #if USE_ALL_PARMSETS
       do { // If we start with a new parmset each time, we'll use them all relatively equally and can see which ones are best
          if (++starting_parmset >= MAXPARMSETS) starting_parmset = 0; }
@@ -1828,9 +2996,17 @@ done:;
    }  // next line of the file
 endfile:
    if (numblks >= numblks_limit) rlog("\n***blklimit=%d reached\n", numblks_limit);
+   if (redecode_basefilename[0]) {
+      if (redecode_pending) { // we ran out of data while looking for it
+         ++numblks_redecode_lost;
+         redecode_copy(redecode_pending, redecode_pending_buf);
+         redecode_pending = NULLP; }
+      redecode_close(); }
    if (tap_format && outf) output_tap_marker(0xffffffffl);
    if (do_txtfile) txtfile_close();
    close_file();
+   deadline_retries();
+   if (manifest) manifest_close();
    trace_close();
    return ok; }
 
@@ -1894,21 +3070,15 @@ int main(int argc, char *argv[]) {
    if (argno == 0) {
       fprintf(stderr, "\n*** No <basefilename> given\n\n");
       SayUsage(); exit(4); }
-   if (argc > argno + 1) {
+   if (argc > argno + 1 && !fuse) {
       fprintf(stderr, "\n*** unknown parameter: %s\n\n", argv[argno]);
       SayUsage(); exit(4); }
+   if (fuse && argc < argno + 2) {
+      fprintf(stderr, "\n*** -fuse needs at least two <basefilename>s\n\n");
+      SayUsage(); exit(4); }
 
    // break the commandline parameter into filename and extension, if one we recognize was given
-   strlcpy(cmdfilename, argv[argno], sizeof(cmdfilename));
-   char *filename_end = strrchr(cmdfilename, '.'); // last .
-   if (filename_end &&
-         (strcasecmp(filename_end, ".tap") == 0
-          || strcasecmp(filename_end, ".csv") == 0
-          || strcasecmp(filename_end, ".tbin") == 0)) {
-      strlcpy(cmdfileext, filename_end, sizeof(cmdfileext)); // copy the extension, with the dot
-      dlog("extension: %s\n", cmdfileext);
-      *filename_end = 0; } // and remove it from the cmdfilename
-   else cmdfileext[0] = 0;  // no extension was given
+   split_filename(argv[argno], cmdfilename, cmdfileext);
 
    //TODO: Move what follows into process_file so we do it for each file of a list?
    // Nah. A more elegant solution would be to gather all the options into a
@@ -1931,7 +3101,25 @@ int main(int argc, char *argv[]) {
    else {  // do a real mag tape decoding
       assert(mode != WW || !multiple_tries, "Sorry, multiple decoding tries is not implemented yet for Whirlwind");
       start_time = time(NULL);
-      if (filelist || strcasecmp(cmdfileext, ".txt") == 0) {  // process a list of files
+      start_wall_secs = wall_secs();
+      if (fuse) { // decode several captures of the same tape, then fuse them into one .tap file
+         assert(!baseoutfilename_given, "-outf can't be used with -fuse");
+         for (; argno < argc; ++argno) {
+            split_filename(argv[argno], cmdfilename, cmdfileext);
+            assert(strlen(outpathname) + strlen(cmdfilename) < MAXPATH - 1, "path + basename too long");
+            strcpy(baseoutfilename, outpathname);
+            strcat(baseoutfilename, cmdfilename);
+            strncpy(baseinfilename, cmdfilename, MAXPATH - 5);
+            baseinfilename[MAXPATH - 5] = '\0';
+            numblks = numtapemarks = 0; // (each capture is a separate tape)
+            numoutbytes = 0;
+            data_start_time = last_block_time = 0;
+            fuse_start_capture();
+            bool result = process_file(argc, argv, cmdfileext);
+            printf("%s: %s\n", baseinfilename, result ? "ok" : "bad"); }
+         fuse_captures(); }
+
+      else if (filelist || strcasecmp(cmdfileext, ".txt") == 0) {  // process a list of files
          char filename[MAXPATH];
          strncpy(filename, cmdfilename, MAXPATH - 5); filename[MAXPATH - 5] = '\0';
          strcat(filename, ".txt");
@@ -1979,7 +3167,24 @@ int main(int argc, char *argv[]) {
                rlog("\n");
                if (mode == WW && num_flux_polarity_changes > 0) rlog("  the flux polarity changed %d time%s during decoding\n",
                         num_flux_polarity_changes, num_flux_polarity_changes > 1 ? "s" : "");
-               if (numblks_unusable > 0) rlog("  %d blocks were unusable and were not written\n", numblks_unusable); }
+               if (numblks_unusable > 0) rlog("  %d blocks were unusable and were not written\n", numblks_unusable);
+               if (bidir && mode == PE) rlog("  %d block%s repaired by decoding backwards\n", numblks_bidir, numblks_bidir != 1 ? "s were" : " was");
+               if (vote) rlog("  %d block%s assembled by voting across parmsets\n", numblks_voted, numblks_voted != 1 ? "s were" : " was");
+               if (do_viterbi && mode == GCR) rlog("  %d block%s zero counts changed by the sequence detector\n",
+                                                      numblks_mlchanged, numblks_mlchanged != 1 ? "s had" : " had");
+               if (deadline_secs > 0) rlog("  %d block%s cut short by -deadline, and %d %s rewritten later\n",
+                                              numblks_cutshort, numblks_cutshort != 1 ? "s were" : " was",
+                                              numblks_patched, numblks_patched != 1 ? "were" : "was");
+               if (mixed_formats) rlog("  the format changed %d time%s at tapemarks\n", num_format_changes, num_format_changes != 1 ? "s" : "");
+               if (numblks_tbindamaged) rlog("  %d block%s decoded from bad .tbin data chunks\n",
+                                                numblks_tbindamaged, numblks_tbindamaged != 1 ? "s were" : " was");
+               models_report();
+               if (redecode_basefilename[0]) {
+                  rlog("  %d perfect block%s copied from %s.tap, and %d %s decoded again\n", numblks_copied,
+                       numblks_copied != 1 ? "s were" : " was", redecode_basefilename, numblks_redecoded, numblks_redecoded != 1 ? "were" : "was");
+                  rlog("  of those, %d improved, %d kept the earlier decoding because it was better, and %d weren't found\n",
+                       numblks_redecode_improved, numblks_redecode_kept, numblks_redecode_lost); }
+               if (replay_speed > 0) show_replay_latencies(); }
             close_summary_file();
             if (multiple_tries) {
                rlog("  %d good blocks had to try more than one parmset\n", numblks_goodmultiple);
@@ -2012,6 +3217,20 @@ int main(int argc, char *argv[]) {
                     num_flux_polarity_changes == 0 ? (flux_direction_current == FLUX_POS ? "pos" : "neg") : "pos&neg",
                     track_order_string, timenow - data_start_time, numtapemarks, numblks, numdatabytes,
                     numblks_err, numblks_warn, num_flux_polarity_changes, skew_ok ? 'y' : 'n');
+            fclose(summf); }
+         if (summrobfilename[0]) { // for graphing how decoding copes with faults, like those csvtbin can inject
+            double decode_secs = wall_secs() - start_wall_secs;
+            int tries = 0;
+            for (int i = 0; i < MAXPARMSETS; ++i) tries += parmsetsptr[i].tried;
+            assert((summf = fopen(summrobfilename, "a")) != NULLP, "can't open summary file %s", summrobfilename);
+            fseek(summf, 0, SEEK_END);
+            if (ftell(summf) == 0) fprintf(summf, "file, description, blocks, error blocks, warning blocks, %% good, "
+                                              "parmset tries, tries/block, decode secs, secs/block\n");
+            fprintf(summf, "\"%s\",\"%s\", %d, %d, %d, %.1f, %d, %.2f, %.3f, %.5f\n",
+                    baseinfilename, tbin_hdr.descr, numblks, numblks_err, numblks_warn,
+                    numblks == 0 ? 0 : 100. * (numblks - numblks_err) / numblks,
+                    tries, numblks == 0 ? 0 : (double)tries / numblks,
+                    decode_secs, numblks == 0 ? 0 : decode_secs / numblks);
             fclose(summf); } } }
 
    return 0; }
@@ -0,0 +1,303 @@
+//file: tapdiff.c
+/******************************************************************************
+
+Compare two SIMH .tap format tape image files record by record.
+
+   tapdiff <options> <filename1> <filename2>
+
+The inputs are <filename1>.tap and <filename2>.tap, or the names as given
+if they already end in .tap. Each file is read once, sequentially and in
+big chunks, and for each record we remember its length, error flag, file
+offset, and a 64-bit hash of its data, computed 8 bytes at a time. Then the two lists of records
+are aligned, and we report which records are identical, changed, deleted
+from the first file, or inserted in the second file. For changed records,
+the data is reread to find the offset of the first byte that differs.
+
+Records match if they are both tapemarks, or are data records with the
+same length, error flag, and hash. When records don't match, we look ahead
+up to -window=n records (default 100) in each file for the nearest place
+where they match again. If there is none, the records are "changed".
+
+options:  -window=n   how far ahead to look to realign the records
+          -summary    show only the summary, not each difference
+
+The exit code is 0 if the files have the same records, 1 if they don't,
+and 8 for errors. A typical use is to check a new decoding of a tape
+against a previous one:
+
+   tapdiff oldrun/tape123 tape123
+
+*******************************************************************************
+
+---CHANGE LOG ---
+
+18 Oct 2026, L. Shustek, written
+
+*******************************************************************************
+Copyright (C) 2026, Len Shustek
+
+The MIT License (MIT): Permission is hereby granted, free of charge, to any
+person obtaining a copy of this software and associated documentation files
+(the "Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom
+the Software is furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+typedef unsigned char byte;
+
+#if defined(_WIN32)
+#define fseeko _fseeki64
+#endif
+
+#define MAXPATH 300
+#define MAXRECORD 0xffffff       // the largest .tap record
+#define IOBUFSIZE (1 << 25)      // how much of the file we read at a time; must be more than MAXRECORD+8
+#define TAPEMARK 0xffffffffL     // the "length" we give tapemarks
+
+struct rec_t {          // a record in a .tap file
+   uint32_t length;     // its data length, or TAPEMARK
+   bool errflag;        // did it have the error flag?
+   int64_t offset;      // where its data starts in the file
+   uint64_t hash; };    // the hash of its data
+
+struct tapfile_t {      // one of the .tap files
+   char name[MAXPATH];
+   FILE *f;
+   struct rec_t *recs;
+   int numrecs, numalloc;
+   int64_t numbytes;    // total data bytes
+   // for reading
+   byte *buf;
+   int buflen, bufpos;
+   int64_t position; }  // the file position of buf[bufpos]
+files[2];
+
+int window = 100;
+bool summary_only = false;
+
+void fatal(const char *msg, ...) {
+   va_list args;
+   va_start(args, msg);
+   fprintf(stderr, "\n");
+   vfprintf(stderr, msg, args);
+   fprintf(stderr, "\n");
+   va_end(args);
+   exit(8); }
+
+void SayUsage(void) {
+   static const char *usage[] = {
+      "tapdiff: compare the records of two SIMH .tap files",
+      "use: tapdiff <options> <filename1> <filename2>",
+      "  the inputs are <filename>.tap, SIMH tape images",
+      "  the output is to stdout",
+      "options:",
+      "  -window=n   look up to n records ahead to realign (default 100)",
+      "  -summary    show only the summary, not each difference",
+      "the exit code is 0 if the records are the same, 1 if they aren't",
+      NULL };
+   for (int i = 0; usage[i]; ++i) fprintf(stderr, "%s\n", usage[i]); }
+
+bool opt_key(const char* arg, const char* keyword) {
+   do { // check for a keyword option and nothing after it
+      if (toupper(*arg++) != *keyword++) return false; }
+   while (*keyword);
+   return *arg == '\0'; }
+
+bool opt_int(const char* arg, const char* keyword, int *pval, int min, int max) {
+   do { // check for a "keyword=integer" option and nothing after it
+      if (toupper(*arg++) != *keyword++)
+         return false; }
+   while (*keyword);
+   int num, nch;
+   if (sscanf(arg, "%d%n", &num, &nch) != 1
+         || num < min || num > max || arg[nch] != '\0') return false;
+   *pval = num;
+   return true; }
+
+bool parse_option(char *option) {
+   char *arg = option + 1;
+   if (option[0] != '-') return false;
+   else if (opt_int(arg, "WINDOW=", &window, 1, 100000));
+   else if (opt_key(arg, "SUMMARY")) summary_only = true;
+   else {
+      fatal("bad option: %s\n\n", option); }
+   return true; }
+
+int HandleOptions(int argc, char *argv[]) {
+   /* returns the index of the first argument that is not an option */
+   int firstnonoption = 0;
+   for (int i = 1; i < argc; i++) {
+      if (!parse_option(argv[i])) { // end of switches
+         firstnonoption = i;
+         break; } }
+   return firstnonoption; }
+
+//----------------- reading and indexing
+
+static int available(struct tapfile_t *t, int count) {
+   // make the next "count" bytes contiguous in the buffer, if the file has that many; return how many there are
+   if (t->buflen - t->bufpos < count) { // move what's left to the start, and read more
+      int left = t->buflen - t->bufpos;
+      memmove(t->buf, t->buf + t->bufpos, left);
+      t->position += t->bufpos;
+      t->bufpos = 0;
+      t->buflen = left + (int)fread(t->buf + left, 1, IOBUFSIZE - left, t->f); }
+   return t->buflen - t->bufpos; }
+
+static bool get_marker(struct tapfile_t *t, uint32_t *pval) { // 4-byte little-endian unsigned integer
+   int count = available(t, 4);
+   if (count == 0) return false; // clean endfile: treat as end of medium
+   if (count < 4) fatal("%s: endfile in the middle of a marker", t->name);
+   byte *p = t->buf + t->bufpos;
+   *pval = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+   t->bufpos += 4;
+   return true; }
+
+static uint64_t hash_data(struct tapfile_t *t, uint32_t length) { // hash and skip over the record data
+   // This is FNV-1a applied to 8-byte words, with a shift to mix the high bits back down.
+   uint64_t hash = 0xcbf29ce484222325ULL, word;
+   if (available(t, length) < (int)length) fatal("%s: endfile in the middle of a record", t->name);
+   byte *p = t->buf + t->bufpos, *end = p + length;
+   for (; p + 8 <= end; p += 8) {
+      memcpy(&word, p, 8);
+      hash = (hash ^ word) * 0x100000001b3ULL;
+      hash ^= hash >> 29; }
+   for (; p < end; ++p) hash = (hash ^ *p) * 0x100000001b3ULL;
+   t->bufpos += length;
+   return hash ^ length; }
+
+static void add_record(struct tapfile_t *t, uint32_t length, bool errflag, int64_t offset, uint64_t hash) {
+   if (t->numrecs >= t->numalloc) {
+      t->numalloc = t->numalloc == 0 ? 10000 : 2 * t->numalloc;
+      t->recs = realloc(t->recs, t->numalloc * sizeof(struct rec_t));
+      if (!t->recs) fatal("can't allocate %d records", t->numalloc); }
+   struct rec_t *r = &t->recs[t->numrecs++];
+   r->length = length;
+   r->errflag = errflag;
+   r->offset = offset;
+   r->hash = hash; }
+
+void index_file(struct tapfile_t *t, const char *name) { // read the file and make a list of its records
+   size_t len = strlen(name);
+   if (len >= 4 && strcmp(name + len - 4, ".tap") == 0) snprintf(t->name, MAXPATH, "%s", name);
+   else snprintf(t->name, MAXPATH, "%s.tap", name);
+   if ((t->f = fopen(t->name, "rb")) == NULL) fatal("can't open \"%s\"", t->name);
+   t->buf = malloc(IOBUFSIZE);
+   if (!t->buf) fatal("can't allocate the I/O buffer");
+   t->buflen = t->bufpos = 0;
+   t->position = 0;
+   uint32_t marker;
+   while (get_marker(t, &marker)) {
+      if (marker == 0xffffffffL) break; // end of medium
+      if (marker == 0xfffffffeL) continue; // erase gap
+      if (marker == 0x00000000L) add_record(t, TAPEMARK, false, t->position + t->bufpos, 0);
+      else { // data record
+         if (marker & 0x7f000000L) fatal("%s: bad marker %08lX at offset %lld", t->name, (unsigned long)marker, (long long)(t->position + t->bufpos - 4));
+         uint32_t length = marker & MAXRECORD;
+         int64_t offset = t->position + t->bufpos;
+         uint64_t hash = hash_data(t, length);
+         if (length & 1) { // data is padded to an even number of bytes
+            if (available(t, 1) < 1) fatal("%s: endfile in the middle of a record", t->name);
+            ++t->bufpos; }
+         uint32_t endmarker;
+         if (!get_marker(t, &endmarker) || (endmarker & MAXRECORD) != length)
+            fatal("%s: bad ending marker %08lX for the record at offset %lld", t->name, (unsigned long)endmarker, (long long)offset);
+         add_record(t, length, (marker & 0x80000000L) != 0, offset, hash);
+         t->numbytes += length; } }
+   free(t->buf); }
+
+//----------------- comparing
+
+static bool same(struct rec_t *a, struct rec_t *b) {
+   return a->length == b->length && a->errflag == b->errflag && a->hash == b->hash; }
+
+static int64_t first_difference(struct rec_t *a, struct rec_t *b) { // reread to find the first different byte, or -1
+   static byte bufa[MAXRECORD + 1], bufb[MAXRECORD + 1];
+   if (a->length == TAPEMARK || b->length == TAPEMARK) return 0;
+   uint32_t len = a->length < b->length ? a->length : b->length;
+   if (fseeko(files[0].f, a->offset, SEEK_SET) != 0 || fread(bufa, 1, len, files[0].f) != len
+         || fseeko(files[1].f, b->offset, SEEK_SET) != 0 || fread(bufb, 1, len, files[1].f) != len)
+      fatal("can't reread records at offsets %lld and %lld", (long long)a->offset, (long long)b->offset);
+   for (uint32_t i = 0; i < len; ++i)
+      if (bufa[i] != bufb[i]) return i;
+   return a->length != b->length ? (int64_t)len : -1; }
+
+static void show_rec(struct rec_t *r) {
+   if (r->length == TAPEMARK) printf("tapemark");
+   else printf("%u bytes%s", r->length, r->errflag ? " with errors" : ""); }
+
+int main(int argc, char *argv[]) {
+   if (argc == 1) {
+      SayUsage();
+      exit(4); }
+   int fn = HandleOptions(argc, argv);
+   if (fn == 0 || fn + 2 != argc) fatal("two filenames must be given");
+   clock_t start = clock();
+   for (int i = 0; i < 2; ++i) index_file(&files[i], argv[fn + i]);
+   int identical = 0, changed = 0, deleted = 0, inserted = 0, flagonly = 0;
+   int a = 0, b = 0;
+   struct rec_t *ra = files[0].recs, *rb = files[1].recs;
+   int na = files[0].numrecs, nb = files[1].numrecs;
+   while (a < na || b < nb) {
+      if (a < na && b < nb && same(&ra[a], &rb[b])) { // the usual case
+         ++identical; ++a; ++b;
+         continue; }
+      int del = 0, ins = 0;
+      if (a + 1 < na && b + 1 < nb && same(&ra[a + 1], &rb[b + 1])) ; // a changed record with a match after it
+      else for (int d = 1; d <= window && !del && !ins; ++d) { // look for the nearest realignment
+            if (a + d < na && b < nb && same(&ra[a + d], &rb[b])) del = d;
+            else if (b + d < nb && a < na && same(&ra[a], &rb[b + d])) ins = d; }
+      if (a >= na) ins = nb - b; // the rest of the second file was added
+      else if (b >= nb) del = na - a; // the rest of the first file was removed
+      for (; del > 0; --del, ++a) {
+         ++deleted;
+         if (!summary_only) {
+            printf("deleted  record %d at offset %lld of %s: ", a + 1, (long long)ra[a].offset, files[0].name);
+            show_rec(&ra[a]);
+            printf("\n"); } }
+      for (; ins > 0; --ins, ++b) {
+         ++inserted;
+         if (!summary_only) {
+            printf("inserted record %d at offset %lld of %s: ", b + 1, (long long)rb[b].offset, files[1].name);
+            show_rec(&rb[b]);
+            printf("\n"); } }
+      if (a < na && b < nb && !same(&ra[a], &rb[b])) { // we didn't realign, so the records are different
+         int64_t diff = first_difference(&ra[a], &rb[b]);
+         if (diff < 0) ++flagonly;
+         else ++changed;
+         if (!summary_only) {
+            printf("changed  record %d at offset %lld -> record %d at offset %lld: ", a + 1, (long long)ra[a].offset, b + 1, (long long)rb[b].offset);
+            show_rec(&ra[a]);
+            printf(" -> ");
+            show_rec(&rb[b]);
+            if (diff < 0) printf(", only the error flag differs\n");
+            else printf(", first difference at byte %lld\n", (long long)diff); }
+         ++a; ++b; } }
+   double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+   printf("%s: %d records, %lld data bytes\n", files[0].name, na, (long long)files[0].numbytes);
+   printf("%s: %d records, %lld data bytes\n", files[1].name, nb, (long long)files[1].numbytes);
+   printf("%d identical, %d changed, %d with only the error flag changed, %d deleted, %d inserted\n",
+          identical, changed, flagonly, deleted, inserted);
+   if (secs > 0) printf("compared in %.2f seconds, %.0f MB/second\n", secs, (files[0].numbytes + files[1].numbytes) / secs / 1e6);
+   fclose(files[0].f);
+   fclose(files[1].f);
+   return identical == na && identical == nb ? 0 : 1; }
+
+//*